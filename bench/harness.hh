@@ -0,0 +1,324 @@
+/*
+ * harness.hh
+ *
+ * Copyright 2018-2022 Franz Brauße <fb@paxle.org>
+ *
+ * See the LICENSE file for terms of distribution.
+ */
+
+#ifndef KAY_BENCH_HARNESS_HH
+#define KAY_BENCH_HARNESS_HH
+
+/* Minimal benchmark harness with the interface and JSON output format of
+ * Google Benchmark, so that the results can be processed by its tools, e.g.
+ * compare.py, without depending on it.
+ *
+ * Options:
+ *   --benchmark_filter=REGEX     run only benchmarks whose name matches
+ *   --benchmark_min_time=SEC     minimum measured time per benchmark [0.2]
+ *   --benchmark_out=FILE         write the results as JSON to FILE
+ *   --benchmark_context=K=V      add K to the "context" of the JSON output
+ *   --benchmark_list_tests       list the names and exit
+ */
+
+#include <cstdio>
+#include <cstdlib>	/* atof */
+#include <cstring>
+#include <cstdint>
+#include <ctime>	/* clock_gettime */
+#include <chrono>
+#include <string>
+#include <vector>
+#include <regex>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <thread>	/* hardware_concurrency */
+#include <unistd.h>	/* gethostname */
+
+namespace bench {
+
+template <typename T>
+inline void do_not_optimize(T const &v)
+{
+	asm volatile("" : : "r,m"(v) : "memory");
+}
+
+template <typename T>
+inline void do_not_optimize(T &v)
+{
+	asm volatile("" : "+r,m"(v) : : "memory");
+}
+
+class state {
+
+	using clock = std::chrono::steady_clock;
+
+	std::vector<long> args;
+	uint64_t iters;
+	clock::time_point t0;
+	double c0;
+	double real = 0, cpu = 0;
+	uint64_t bytes = 0, items = 0;
+	std::string error;
+
+	static double cpu_now()
+	{
+		timespec ts;
+		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+		return ts.tv_sec + ts.tv_nsec * 1e-9;
+	}
+
+	void start()
+	{
+		c0 = cpu_now();
+		t0 = clock::now();
+	}
+
+	void stop()
+	{
+		real = std::chrono::duration<double>(clock::now() - t0).count();
+		cpu = cpu_now() - c0;
+	}
+
+	friend struct runner;
+
+public:
+	state(std::vector<long> args, uint64_t iters)
+	: args(std::move(args)), iters(iters) {}
+
+	struct iterator {
+		state *s;
+		uint64_t left;
+
+		/* not a scalar, which would warn of unused loop variables */
+		struct value { ~value() {} };
+
+		value operator*() const { return {}; }
+		void operator++() { --left; }
+		bool operator!=(const iterator &) const
+		{
+			if (left)
+				return true;
+			s->stop();
+			return false;
+		}
+	};
+
+	/* starts the timer; the range-for loop over *this stops it */
+	iterator begin() { start(); return { this, iters }; }
+	iterator end() { return { this, 0 }; }
+
+	long range(size_t i = 0) const { return args[i]; }
+	uint64_t iterations() const { return iters; }
+
+	void set_bytes_processed(uint64_t n) { bytes = n; }
+	void set_items_processed(uint64_t n) { items = n; }
+	void skip_with_error(std::string msg) { error = std::move(msg); }
+};
+
+struct benchmark {
+	std::string name;
+	void (*fn)(state &);
+	std::vector<std::vector<long>> args;
+};
+
+inline std::vector<benchmark> & registry()
+{
+	static std::vector<benchmark> r;
+	return r;
+}
+
+struct registration {
+	registration(const char *name, void (*fn)(state &),
+	             std::vector<std::vector<long>> args = {})
+	{
+		registry().push_back({ name, fn, std::move(args) });
+	}
+};
+
+struct result {
+	std::string name;
+	uint64_t iterations;
+	double real_ns, cpu_ns; /* per iteration */
+	double bytes_per_second, items_per_second;
+	std::string error;
+};
+
+struct runner {
+
+	double min_time = 0.2;
+
+	result run(const std::string &name, void (*fn)(state &), const std::vector<long> &args)
+	{
+		uint64_t n = 1;
+		for (;;) {
+			state s(args, n);
+			fn(s);
+			if (!s.error.empty())
+				return { name, 0, 0, 0, 0, 0, s.error };
+			if (s.real >= min_time || n >= 1000000000) {
+				double secs = std::max(s.cpu, 1e-12);
+				return { name, n, s.real / n * 1e9, s.cpu / n * 1e9,
+				         s.bytes / secs, s.items / secs, {} };
+			}
+			/* aim for 1.4 times the minimum, growing at most 10-fold */
+			double f = s.real > 0 ? min_time * 1.4 / s.real : 10;
+			n = std::max<uint64_t>(n + 1, n * std::min(f, 10.0));
+		}
+	}
+};
+
+inline std::string json_str(const std::string &s)
+{
+	std::string r = "\"";
+	for (char c : s) {
+		if (c == '"' || c == '\\')
+			r += '\\';
+		r += c;
+	}
+	return r + "\"";
+}
+
+inline void write_json(std::ostream &os, const char *exe,
+                       const std::vector<std::pair<std::string,std::string>> &ctx,
+                       const std::vector<result> &rs)
+{
+	char host[256] = "";
+	gethostname(host, sizeof(host) - 1);
+	char date[64];
+	time_t now = time(nullptr);
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+	os << "{\n  \"context\": {\n"
+	   << "    \"date\": " << json_str(date) << ",\n"
+	   << "    \"host_name\": " << json_str(host) << ",\n"
+	   << "    \"executable\": " << json_str(exe) << ",\n"
+	   << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n";
+	for (const auto &[k,v] : ctx)
+		os << "    " << json_str(k) << ": " << json_str(v) << ",\n";
+#ifdef NDEBUG
+	os << "    \"library_build_type\": \"release\"\n";
+#else
+	os << "    \"library_build_type\": \"debug\"\n";
+#endif
+	os << "  },\n  \"benchmarks\": [";
+	const char *sep = "\n";
+	for (const result &r : rs) {
+		os << sep << "    {\n"
+		   << "      \"name\": " << json_str(r.name) << ",\n"
+		   << "      \"run_name\": " << json_str(r.name) << ",\n"
+		   << "      \"run_type\": \"iteration\",\n"
+		   << "      \"repetitions\": 1,\n"
+		   << "      \"repetition_index\": 0,\n"
+		   << "      \"threads\": 1,\n";
+		if (!r.error.empty())
+			os << "      \"error_occurred\": true,\n"
+			   << "      \"error_message\": " << json_str(r.error) << ",\n";
+		os << "      \"iterations\": " << r.iterations << ",\n"
+		   << "      \"real_time\": " << r.real_ns << ",\n"
+		   << "      \"cpu_time\": " << r.cpu_ns << ",\n";
+		if (r.bytes_per_second)
+			os << "      \"bytes_per_second\": " << r.bytes_per_second << ",\n";
+		if (r.items_per_second)
+			os << "      \"items_per_second\": " << r.items_per_second << ",\n";
+		os << "      \"time_unit\": \"ns\"\n    }";
+		sep = ",\n";
+	}
+	os << "\n  ]\n}\n";
+}
+
+/* runs the registered benchmarks as selected by the command line options */
+inline int main(int argc, char **argv,
+                std::vector<std::pair<std::string,std::string>> ctx = {})
+{
+	runner rn;
+	std::regex filter(".*");
+	std::string out;
+	bool list = false;
+	for (int i=1; i<argc; i++) {
+		std::string a = argv[i];
+		auto opt = [&](const char *o) -> const char * {
+			size_t n = strlen(o);
+			return a.compare(0, n, o) ? nullptr : argv[i] + n;
+		};
+		if (const char *v = opt("--benchmark_filter="))
+			filter = std::regex(v);
+		else if (const char *v = opt("--benchmark_min_time="))
+			rn.min_time = atof(v);
+		else if (const char *v = opt("--benchmark_out="))
+			out = v;
+		else if (const char *v = opt("--benchmark_context=")) {
+			const char *eq = strchr(v, '=');
+			if (!eq) {
+				fprintf(stderr, "%s: expected K=V in '%s'\n", argv[0], argv[i]);
+				return 1;
+			}
+			ctx.emplace_back(std::string(v, eq), eq + 1);
+		} else if (a == "--benchmark_list_tests")
+			list = true;
+		else {
+			fprintf(stderr, "%s: unknown option '%s'\n", argv[0], argv[i]);
+			return 1;
+		}
+	}
+
+	std::vector<std::pair<std::string,const benchmark *>> todo;
+	std::vector<std::vector<long>> todo_args;
+	for (const benchmark &b : registry()) {
+		std::vector<std::vector<long>> as = b.args;
+		if (as.empty())
+			as.emplace_back();
+		for (const std::vector<long> &a : as) {
+			std::string name = b.name;
+			for (long v : a)
+				name += "/" + std::to_string(v);
+			if (!std::regex_search(name, filter))
+				continue;
+			todo.emplace_back(name, &b);
+			todo_args.push_back(a);
+		}
+	}
+	if (list) {
+		for (const auto &[name,b] : todo)
+			printf("%s\n", name.c_str());
+		return 0;
+	}
+
+	for (const auto &[k,v] : ctx)
+		printf("%s: %s\n", k.c_str(), v.c_str());
+	printf("%-40s %15s %15s %12s\n", "Benchmark", "Time", "CPU", "Iterations");
+	std::vector<result> rs;
+	for (size_t i=0; i<todo.size(); i++) {
+		result r = rn.run(todo[i].first, todo[i].second->fn, todo_args[i]);
+		if (r.error.empty())
+			printf("%-40s %12.1f ns %12.1f ns %12llu\n", r.name.c_str(),
+			       r.real_ns, r.cpu_ns, (unsigned long long)r.iterations);
+		else
+			printf("%-40s ERROR: %s\n", r.name.c_str(), r.error.c_str());
+		fflush(stdout);
+		rs.push_back(std::move(r));
+	}
+	if (!out.empty()) {
+		std::ofstream f(out);
+		write_json(f, argv[0], ctx, rs);
+		if (!f) {
+			fprintf(stderr, "%s: error writing '%s'\n", argv[0], out.c_str());
+			return 1;
+		}
+	}
+	return 0;
+}
+
+}
+
+#define KAY_BENCH_CAT2(a,b)	a##b
+#define KAY_BENCH_CAT(a,b)	KAY_BENCH_CAT2(a,b)
+
+/* KAY_BENCHMARK(fn, {a0...}, {a1...}, ...) registers fn(bench::state &) to
+ * be run once per argument list, reported as fn/a0.../, or once without
+ * arguments if there are none */
+#define KAY_BENCHMARK(fn, ...)                                                 \
+	static ::bench::registration KAY_BENCH_CAT(kay_bench_reg_, __LINE__)   \
+		(#fn, fn, std::vector<std::vector<long>> { __VA_ARGS__ })
+
+#endif
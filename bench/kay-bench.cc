@@ -0,0 +1,454 @@
+/*
+ * kay-bench.cc
+ *
+ * Copyright 2018-2022 Franz Brauße <fb@paxle.org>
+ *
+ * See the LICENSE file for terms of distribution.
+ */
+
+/* Microbenchmarks of kay's entry points, built once per backend by 'make
+ * bench': with KAY_USE_FLINT=1 or KAY_USE_GMPXX=1. The operand sizes given as
+ * arguments are in bits. */
+
+#include <kay/numbers.hh>
+#include <kay/numbits.hh>
+#include <kay/dbl-ival.hh>
+#include <kay/lazy-q.hh>
+
+#include <random>
+
+#include "harness.hh"
+
+using namespace kay;
+using namespace kay::literals;
+using bench::state;
+using bench::do_not_optimize;
+
+namespace {
+
+#define SIZES	{64}, {256}, {1024}, {4096}, {16384}
+
+/* uniformly random operands, deterministic across runs */
+gmp_randclass & rnd()
+{
+	static gmp_randclass r(gmp_randinit_default);
+	static bool seeded = (r.seed(0x6b6179), true);
+	(void)seeded;
+	return r;
+}
+
+/* a random integer of exactly 'bits' bits */
+Z random_Z(long bits)
+{
+	mpz_class v = rnd().get_z_bits(bits);
+	mpz_setbit(v.get_mpz_t(), bits - 1);
+	return Z(v);
+}
+
+/* a random canonical rational with numerator and denominator of 'bits' bits */
+Q random_Q(long bits)
+{
+	Q q;
+	q.get_num() = random_Z(bits);
+	q.get_den() = random_Z(bits);
+	canonicalize(q);
+	return q;
+}
+
+/* decimal digits of a number of 'bits' bits */
+std::string random_digits(long bits)
+{
+	return to_string(random_Z(bits));
+}
+
+/* ------------------------------------------------------------------------
+ * arithmetic
+ * ------------------------------------------------------------------------ */
+
+void Z_add(state &st)
+{
+	Z a = random_Z(st.range()), b = random_Z(st.range());
+	for (auto _ : st) {
+		Z r = a + b;
+		do_not_optimize(r);
+	}
+}
+KAY_BENCHMARK(Z_add, SIZES);
+
+void Z_mul(state &st)
+{
+	Z a = random_Z(st.range()), b = random_Z(st.range());
+	for (auto _ : st) {
+		Z r = a * b;
+		do_not_optimize(r);
+	}
+}
+KAY_BENCHMARK(Z_mul, SIZES);
+
+/* 2n by n bits */
+void Z_div(state &st)
+{
+	Z a = random_Z(2 * st.range()), b = random_Z(st.range());
+	for (auto _ : st) {
+		Z r = a / b;
+		do_not_optimize(r);
+	}
+}
+KAY_BENCHMARK(Z_div, SIZES);
+
+void Z_gcd(state &st)
+{
+	Z a = random_Z(st.range()), b = random_Z(st.range());
+	for (auto _ : st) {
+		Z r = gcd(a, b);
+		do_not_optimize(r);
+	}
+}
+KAY_BENCHMARK(Z_gcd, SIZES);
+
+void Q_add(state &st)
+{
+	Q a = random_Q(st.range()), b = random_Q(st.range());
+	for (auto _ : st) {
+		Q r = a + b;
+		do_not_optimize(r);
+	}
+}
+KAY_BENCHMARK(Q_add, SIZES);
+
+void Q_mul(state &st)
+{
+	Q a = random_Q(st.range()), b = random_Q(st.range());
+	for (auto _ : st) {
+		Q r = a * b;
+		do_not_optimize(r);
+	}
+}
+KAY_BENCHMARK(Q_mul, SIZES);
+
+void Q_div(state &st)
+{
+	Q a = random_Q(st.range()), b = random_Q(st.range());
+	for (auto _ : st) {
+		Q r = a / b;
+		do_not_optimize(r);
+	}
+}
+KAY_BENCHMARK(Q_div, SIZES);
+
+/* 64 additions of random rationals with denominators of 'bits' bits */
+void lazy_Q_sum64(state &st)
+{
+	std::vector<Q> v;
+	for (int i=0; i<64; i++)
+		v.push_back(random_Q(st.range()));
+	for (auto _ : st) {
+		lazy_Q s;
+		for (const Q &q : v)
+			s += q;
+		Q r = s.get();
+		do_not_optimize(r);
+	}
+	st.set_items_processed(st.iterations() * v.size());
+}
+KAY_BENCHMARK(lazy_Q_sum64, {64}, {256}, {1024});
+
+void Q_sum64(state &st)
+{
+	std::vector<Q> v;
+	for (int i=0; i<64; i++)
+		v.push_back(random_Q(st.range()));
+	for (auto _ : st) {
+		Q s;
+		for (const Q &q : v)
+			s += q;
+		do_not_optimize(s);
+	}
+	st.set_items_processed(st.iterations() * v.size());
+}
+KAY_BENCHMARK(Q_sum64, {64}, {256}, {1024});
+
+/* ------------------------------------------------------------------------
+ * rounding
+ * ------------------------------------------------------------------------ */
+
+void Q_floor(state &st)
+{
+	Q q = random_Q(st.range());
+	for (auto _ : st) {
+		Z r = floor(q);
+		do_not_optimize(r);
+	}
+}
+KAY_BENCHMARK(Q_floor, SIZES);
+
+void Q_ceil(state &st)
+{
+	Q q = random_Q(st.range());
+	for (auto _ : st) {
+		Z r = ceil(q);
+		do_not_optimize(r);
+	}
+}
+KAY_BENCHMARK(Q_ceil, SIZES);
+
+void Q_round(state &st)
+{
+	Q q = random_Q(st.range());
+	for (auto _ : st) {
+		Z r = round(q);
+		do_not_optimize(r);
+	}
+}
+KAY_BENCHMARK(Q_round, SIZES);
+
+void Q_get_d(state &st)
+{
+	Q q = random_Q(st.range());
+	for (auto _ : st) {
+		double d = q.get_d();
+		do_not_optimize(d);
+	}
+}
+KAY_BENCHMARK(Q_get_d, SIZES);
+
+void Z_flt_prec(state &st)
+{
+	Z a = random_Z(st.range());
+	for (auto _ : st) {
+		size_t p = flt_prec(a);
+		do_not_optimize(p);
+	}
+}
+KAY_BENCHMARK(Z_flt_prec, SIZES);
+
+/* ------------------------------------------------------------------------
+ * hashing
+ * ------------------------------------------------------------------------ */
+
+void hash_Z(state &st)
+{
+	Z a = random_Z(st.range());
+	for (auto _ : st) {
+		size_t h = std::hash<Z>{}(a);
+		do_not_optimize(h);
+	}
+}
+KAY_BENCHMARK(hash_Z, SIZES);
+
+void hash_Q(state &st)
+{
+	Q a = random_Q(st.range());
+	for (auto _ : st) {
+		size_t h = std::hash<Q>{}(a);
+		do_not_optimize(h);
+	}
+}
+KAY_BENCHMARK(hash_Q, SIZES);
+
+/* argument in bytes */
+void hash_bytes(state &st)
+{
+	std::vector<unsigned char> v(st.range());
+	std::mt19937_64 g(1);
+	for (unsigned char &c : v)
+		c = g();
+	for (auto _ : st) {
+		size_t h = kay::hash_bytes(v.data(), v.size());
+		do_not_optimize(h);
+	}
+	st.set_bytes_processed(st.iterations() * v.size());
+}
+KAY_BENCHMARK(hash_bytes, {8}, {64}, {1024}, {65536});
+
+/* ------------------------------------------------------------------------
+ * conversion from and to strings
+ * ------------------------------------------------------------------------ */
+
+void from_chars_Z(state &st)
+{
+	std::string s = random_digits(st.range());
+	Z v;
+	for (auto _ : st) {
+		auto r = from_chars(s.data(), s.data() + s.size(), v);
+		do_not_optimize(r);
+		do_not_optimize(v);
+	}
+	st.set_bytes_processed(st.iterations() * s.size());
+}
+KAY_BENCHMARK(from_chars_Z, SIZES);
+
+/* "-<digits>.<digits>e-17" with 'bits' bits in total */
+void from_chars_Q(state &st)
+{
+	std::string s = "-" + random_digits(st.range() / 2) + "." +
+	                random_digits(st.range() / 2) + "e-17";
+	Q v;
+	for (auto _ : st) {
+		auto r = from_chars(s.data(), s.data() + s.size(), v);
+		do_not_optimize(r);
+		do_not_optimize(v);
+	}
+	st.set_bytes_processed(st.iterations() * s.size());
+}
+KAY_BENCHMARK(from_chars_Q, SIZES);
+
+void Q_from_str(state &st)
+{
+	std::string s = random_digits(st.range() / 2) + "." +
+	                random_digits(st.range() / 2) + "e-17";
+	std::vector<char> buf(s.size() + 1);
+	for (auto _ : st) {
+		/* Q_from_str modifies its argument */
+		memcpy(buf.data(), s.c_str(), buf.size());
+		Q v = kay::Q_from_str(buf.data());
+		do_not_optimize(v);
+	}
+	st.set_bytes_processed(st.iterations() * s.size());
+}
+KAY_BENCHMARK(Q_from_str, SIZES);
+
+void to_string_Z(state &st)
+{
+	Z a = random_Z(st.range());
+	for (auto _ : st) {
+		std::string s = to_string(a);
+		do_not_optimize(s);
+	}
+}
+KAY_BENCHMARK(to_string_Z, SIZES);
+
+void to_string_Q(state &st)
+{
+	Q a = random_Q(st.range());
+	for (auto _ : st) {
+		std::string s = to_string(a);
+		do_not_optimize(s);
+	}
+}
+KAY_BENCHMARK(to_string_Q, SIZES);
+
+void dbl_from_chars(state &st)
+{
+	static const char *const in[] = { "0.1", "-2.5e-300", "[1.25,3.75]", "3.14159265358979323846264338327950288" };
+	const char *s = in[st.range()];
+	const char *e = s + strlen(s);
+	dbl::ival v;
+	for (auto _ : st) {
+		auto r = dbl::from_chars(s, e, v);
+		do_not_optimize(r);
+		do_not_optimize(v);
+	}
+}
+KAY_BENCHMARK(dbl_from_chars, {0}, {1}, {2}, {3});
+
+/* ------------------------------------------------------------------------
+ * literals
+ * ------------------------------------------------------------------------ */
+
+void literal_Z_small(state &st)
+{
+	for (auto _ : st) {
+		Z v = 1234567_Z;
+		do_not_optimize(v);
+	}
+}
+KAY_BENCHMARK(literal_Z_small);
+
+void literal_Z_big(state &st)
+{
+	for (auto _ : st) {
+		Z v = 0x123456789abcdef0123456789abcdef0123456789abcdef_Z;
+		do_not_optimize(v);
+	}
+}
+KAY_BENCHMARK(literal_Z_big);
+
+void literal_Q(state &st)
+{
+	for (auto _ : st) {
+		Q v = 3.14159265358979323846264338327950288_Q;
+		do_not_optimize(v);
+	}
+}
+KAY_BENCHMARK(literal_Q);
+
+/* ------------------------------------------------------------------------
+ * double intervals
+ * ------------------------------------------------------------------------ */
+
+std::vector<dbl::ival> random_ivals(size_t n)
+{
+	std::mt19937_64 g(2);
+	std::uniform_real_distribution<double> u(-10, 10);
+	std::vector<dbl::ival> v;
+	for (size_t i=0; i<n; i++) {
+		double a = u(g), b = u(g);
+		v.push_back(dbl::endpts { std::min(a, b), std::max(a, b) });
+	}
+	return v;
+}
+
+/* argument: number of elements */
+void ival_add(state &st)
+{
+	std::vector<dbl::ival> a = random_ivals(st.range()), b = random_ivals(st.range());
+	std::vector<dbl::ival> r(a.size());
+	dbl::rounding_mode m(FE_DOWNWARD);
+	for (auto _ : st) {
+		dbl::add(a.data(), b.data(), a.size(), r.data());
+		do_not_optimize(r.data());
+	}
+	st.set_items_processed(st.iterations() * a.size());
+}
+KAY_BENCHMARK(ival_add, {1024});
+
+void ival_mul(state &st)
+{
+	std::vector<dbl::ival> a = random_ivals(st.range()), b = random_ivals(st.range());
+	std::vector<dbl::ival> r(a.size());
+	dbl::rounding_mode m(FE_DOWNWARD);
+	for (auto _ : st) {
+		dbl::mul(a.data(), b.data(), a.size(), r.data());
+		do_not_optimize(r.data());
+	}
+	st.set_items_processed(st.iterations() * a.size());
+}
+KAY_BENCHMARK(ival_mul, {1024});
+
+void ival_sum(state &st)
+{
+	std::vector<dbl::ival> a = random_ivals(st.range());
+	dbl::rounding_mode m(FE_DOWNWARD);
+	for (auto _ : st) {
+		dbl::ival s = dbl::sum(a.data(), a.size());
+		do_not_optimize(s);
+	}
+	st.set_items_processed(st.iterations() * a.size());
+}
+KAY_BENCHMARK(ival_sum, {1024});
+
+void ival_from_Q(state &st)
+{
+	Q q = random_Q(st.range());
+	for (auto _ : st) {
+		dbl::ival v(q);
+		do_not_optimize(v);
+	}
+}
+KAY_BENCHMARK(ival_from_Q, {64}, {1024});
+
+}
+
+int main(int argc, char **argv)
+{
+#if (KAY_USE_FLINT-0)
+	const char *backend = "flint";
+#else
+	const char *backend = "gmpxx";
+#endif
+	return bench::main(argc, argv, {
+		{ "kay_backend", backend },
+		{ "kay_isa", isa_name(selected_isa()) },
+	});
+}
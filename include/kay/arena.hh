@@ -0,0 +1,248 @@
+/*
+ * arena.hh
+ *
+ * Copyright 2018-2022 Franz Brauße <fb@paxle.org>
+ *
+ * See the LICENSE file for terms of distribution.
+ */
+
+#ifndef KAY_ARENA_HH
+#define KAY_ARENA_HH
+
+#include <vector>
+#include <array>
+#include <optional>
+#include <stdexcept>	/* std::length_error */
+#include <cassert>
+
+#include <kay/bits.hh>
+
+namespace kay {
+
+/* Handles with a generation counter detect the use of erased objects. */
+template <typename H, typename G>
+struct generational {
+	H idx;
+	G gen;
+
+	constexpr friend bool operator==(const generational &a, const generational &b)
+	{ return a.idx == b.idx && a.gen == b.gen; }
+
+	constexpr friend bool operator!=(const generational &a, const generational &b)
+	{ return !(a == b); }
+};
+
+/* Storage for objects of type T in categories Cat, addressed by handles
+ * tagged_idx<Cat,I> instead of pointers. Objects of one category are stored
+ * contiguously in the order of their indices, erased slots are reused before
+ * the storage grows. Cat needs a specialization of kay::cardinality, its
+ * values must be 0, ..., cardinality_v<Cat>-1.
+ *
+ * If G is not void, handles additionally carry a generation of type G, which
+ * is incremented on erasing an object; handles to erased objects are then
+ * rejected by get() and contains(). Without generations such handles refer to
+ * whichever object reuses the slot.
+ *
+ * References to objects are invalidated when an object of the same category
+ * is inserted. */
+template <typename Cat, typename T, typename I = uint32_t, typename G = void>
+class arena {
+
+	using idx_t = tagged_idx<Cat,I>;
+
+	static constexpr size_t n_cats = cardinality_v<Cat>;
+	static constexpr size_t idx_bits = type_bits_v<I> - max_bits_v<Cat>;
+	static constexpr size_t max_size = idx_bits >= type_bits_v<size_t>
+	                                 ? ~(size_t)0 : (size_t)1 << idx_bits;
+
+	static constexpr bool has_gen = !std::is_void_v<G>;
+	using gen_t = std::conditional_t<has_gen,G,unit>;
+
+	struct pool {
+		std::vector<std::optional<T>> slots;
+		std::vector<I> free;
+		std::vector<gen_t> gens;
+	};
+
+	std::array<pool,n_cats> pools;
+	size_t n = 0;
+
+public:
+	using handle = std::conditional_t<has_gen,generational<idx_t,gen_t>,idx_t>;
+
+private:
+	static size_t cat_index(Cat c)
+	{
+		if constexpr (max_bits_v<Cat> == 0)
+			return 0;
+		else
+			return static_cast<size_t>(c);
+	}
+
+	static Cat cat_value(size_t c)
+	{
+		if constexpr (max_bits_v<Cat> == 0)
+			return Cat {};
+		else
+			return static_cast<Cat>(c);
+	}
+
+	static idx_t make_idx(Cat c, I i)
+	{
+		if constexpr (max_bits_v<Cat> == 0) {
+			idx_t r;
+			r.idx = i;
+			return r;
+		} else
+			return idx_t(i, c);
+	}
+
+	static const idx_t & idx_of(const handle &h)
+	{
+		if constexpr (has_gen)
+			return h.idx;
+		else
+			return h;
+	}
+
+	/* the bit-field h.cat sign-extends for signed underlying types of Cat */
+	static size_t cat_of(const idx_t &h)
+	{
+		if constexpr (max_bits_v<Cat> == 0)
+			return 0;
+		else
+			return static_cast<size_t>(h.cat) & (((size_t)1 << idx_t::tag_size) - 1);
+	}
+
+	const pool & pool_of(const handle &h) const { return pools[cat_of(idx_of(h))]; }
+	      pool & pool_of(const handle &h)       { return pools[cat_of(idx_of(h))]; }
+
+	handle make_handle(Cat c, I i) const
+	{
+		if constexpr (has_gen)
+			return { make_idx(c, i), pools[cat_index(c)].gens[i] };
+		else
+			return make_idx(c, i);
+	}
+
+public:
+	/* constructs a T from args in category c */
+	template <typename... Args>
+	handle emplace(Cat c, Args &&... args)
+	{
+		pool &p = pools[cat_index(c)];
+		I i;
+		if (!p.free.empty()) {
+			i = p.free.back();
+			p.slots[i].emplace(std::forward<Args>(args)...);
+			p.free.pop_back();
+		} else {
+			if (p.slots.size() >= max_size)
+				throw std::length_error("kay::arena: indices exhausted");
+			i = p.slots.size();
+			p.slots.emplace_back(std::in_place, std::forward<Args>(args)...);
+			if constexpr (has_gen)
+				p.gens.emplace_back();
+		}
+		n++;
+		return make_handle(c, i);
+	}
+
+	handle insert(Cat c, const T &v) { return emplace(c, v); }
+	handle insert(Cat c, T &&v) { return emplace(c, std::move(v)); }
+
+	bool contains(const handle &h) const
+	{
+		const pool &p = pool_of(h);
+		I i = idx_of(h).idx;
+		if (i >= p.slots.size() || !p.slots[i])
+			return false;
+		if constexpr (has_gen)
+			return p.gens[i] == h.gen;
+		return true;
+	}
+
+	/* nullptr if h does not refer to an object */
+	const T * get(const handle &h) const { return contains(h) ? &*pool_of(h).slots[idx_of(h).idx] : nullptr; }
+	      T * get(const handle &h)       { return contains(h) ? &*pool_of(h).slots[idx_of(h).idx] : nullptr; }
+
+	const T & operator[](const handle &h) const { assert(contains(h)); return *pool_of(h).slots[idx_of(h).idx]; }
+	      T & operator[](const handle &h)       { assert(contains(h)); return *pool_of(h).slots[idx_of(h).idx]; }
+
+	void erase(const handle &h)
+	{
+		assert(contains(h));
+		pool &p = pool_of(h);
+		I i = idx_of(h).idx;
+		p.slots[i].reset();
+		if constexpr (has_gen)
+			p.gens[i]++;
+		p.free.push_back(i);
+		n--;
+	}
+
+	void clear()
+	{
+		for (pool &p : pools) {
+			p.free.clear();
+			for (size_t i=p.slots.size(); i; i--)
+				if (p.slots[i-1]) {
+					p.slots[i-1].reset();
+					if constexpr (has_gen)
+						p.gens[i-1]++;
+				}
+			for (size_t i=p.slots.size(); i; i--)
+				p.free.push_back(i-1);
+		}
+		n = 0;
+	}
+
+	void reserve(Cat c, size_t k) { pools[cat_index(c)].slots.reserve(k); }
+
+	size_t size() const { return n; }
+	size_t size(Cat c) const
+	{
+		const pool &p = pools[cat_index(c)];
+		return p.slots.size() - p.free.size();
+	}
+	bool empty() const { return !n; }
+
+	/* Calls f(handle, T &) for the objects of category c in storage
+	 * order. f must not insert into c. */
+	template <typename F>
+	void for_each(Cat c, F &&f)
+	{
+		pool &p = pools[cat_index(c)];
+		for (size_t i=0; i<p.slots.size(); i++)
+			if (p.slots[i])
+				f(make_handle(c, i), *p.slots[i]);
+	}
+
+	template <typename F>
+	void for_each(Cat c, F &&f) const
+	{
+		const pool &p = pools[cat_index(c)];
+		for (size_t i=0; i<p.slots.size(); i++)
+			if (p.slots[i])
+				f(make_handle(c, i), *p.slots[i]);
+	}
+
+	/* all categories in order */
+	template <typename F>
+	void for_each(F &&f)
+	{
+		for (size_t c=0; c<n_cats; c++)
+			for_each(cat_value(c), f);
+	}
+
+	template <typename F>
+	void for_each(F &&f) const
+	{
+		for (size_t c=0; c<n_cats; c++)
+			for_each(cat_value(c), f);
+	}
+};
+
+}
+
+#endif
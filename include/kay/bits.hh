@@ -13,10 +13,13 @@
 #include <cstdint>
 #include <climits>	/* CHAR_BIT */
 #include <cstddef>	/* size_t */
+#include <cstring>	/* memcpy */
 #include <type_traits>	/* std::integral_constant */
 #include <variant>	/* std::monostate */
 #include <vector>	/* std::vector */
 
+#include <kay/dispatch.hh>
+
 namespace kay {
 
 /* Fowler/Noll/Vo hash */
@@ -104,14 +107,94 @@ template <typename... Ts, typename H> struct hash<std::tuple<Ts...>,H> {
 	}
 };
 
+namespace detail {
+
+KAY_KERNEL size_t hash_bytes(const void *p, size_t n, uint64_t seed) noexcept
+{
+	constexpr uint64_t key[8] = {
+		0xbe4ba423396cfeb8, 0x1cad21f72c81017c, 0xdb979083e96dd4de, 0x1f67b3b7a4a44072,
+		0x78e5c0cc4ee679cb, 0x2172ffcc7dd05a82, 0x8e2443f7744608b8, 0x4c263a81e69035e0,
+	};
+	constexpr uint64_t p32 = 0x9e3779b1, p64 = 0x9e3779b97f4a7c15;
+	const unsigned char *b = static_cast<const unsigned char *>(p);
+	uint64_t acc[8];
+	for (size_t j=0; j<8; j++)
+		acc[j] = key[j] ^ seed;
+	size_t i = 0;
+	for (size_t s=0; i + 64 <= n; i += 64) {
+		uint64_t d[8], t = s * p64;
+		memcpy(d, b + i, 64);
+		/* the key depends on the stripe, otherwise equal words swapped
+		 * between stripes would cancel */
+		for (size_t j=0; j<8; j++) {
+			uint64_t k = d[j] ^ (key[j] + t);
+			acc[j ^ 1] += d[j];
+			acc[j] += (k & 0xffffffff) * (k >> 32);
+		}
+		/* scramble periodically to keep the lanes from saturating */
+		if (++s % 16 == 0)
+			for (size_t j=0; j<8; j++)
+				acc[j] = (acc[j] ^ acc[j] >> 47 ^ key[7-j]) * p32;
+	}
+	uint64_t h = n * p64;
+	for (size_t j=0; j<8; j+=2) {
+		unsigned __int128 m = (unsigned __int128)(acc[j] ^ key[j+1]) * (acc[j+1] ^ key[j]);
+		h += (uint64_t)m ^ (uint64_t)(m >> 64);
+	}
+	for (; i + 8 <= n; i += 8) {
+		uint64_t d;
+		memcpy(&d, b + i, 8);
+		unsigned __int128 m = (unsigned __int128)(d ^ key[i/8 % 8]) * (h ^ p64);
+		h = (uint64_t)m ^ (uint64_t)(m >> 64);
+	}
+	if (i < n) {
+		uint64_t d = 0;
+		memcpy(&d, b + i, n - i);
+		unsigned __int128 m = (unsigned __int128)(d ^ key[n % 8]) * (h ^ p64);
+		h = (uint64_t)m ^ (uint64_t)(m >> 64);
+	}
+	h ^= h >> 37;
+	h *= 0x165667919e3779f9;
+	h ^= h >> 32;
+	return h;
+}
+
+KAY_MULTIVERSION(hash_bytes, size_t, (const void *p, size_t n, uint64_t seed), (p, n, seed))
+
+}
+
+/* Hash of the n bytes at p. 64-byte stripes are accumulated in 8 independent
+ * 64-bit lanes by 32x32->64 bit products of the data mixed with a key, a
+ * scheme like XXH3's that compilers vectorize, followed by a scalar tail and a
+ * final avalanche. Not suitable against adversarial inputs.
+ *
+ * Inputs of at least 256 bytes are hashed by the variant for selected_isa();
+ * all variants compute the same value. */
+inline size_t hash_bytes(const void *p, size_t n, uint64_t seed = 0) noexcept
+{
+	if (n < 256)
+		return detail::hash_bytes(p, n, seed);
+	static size_t (*const f)(const void *, size_t, uint64_t) = detail::hash_bytes_isa::select();
+	return f(p, n, seed);
+}
+
 template <typename T, typename H> struct hash<std::vector<T>,H> {
 
 	size_t operator()(const std::vector<T> &v) const noexcept
 	{
-		H h(size(v));
-		for (const T &x : v)
-			h ^= H(x);
-		return h.v;
+		/* Elements hashed as themselves by std::hash are hashed as one
+		 * span of bytes instead of combining them one by one. */
+		if constexpr ((std::is_integral_v<T> || std::is_enum_v<T>) &&
+		              !std::is_same_v<T,bool> &&
+		              std::has_unique_object_representations_v<T> &&
+		              H::template is_std<T>) {
+			return (H(size(v)) ^ H(hash_bytes(v.data(), sizeof(T) * size(v)))).v;
+		} else {
+			H h(size(v));
+			for (const T &x : v)
+				h ^= H(x);
+			return h.v;
+		}
 	}
 };
 
@@ -229,6 +312,15 @@ template <typename T, typename I = uint32_t>
 using tagged_idx = std::enable_if_t<sizeof(tagged_idx_base<max_bits_v<T>, I, T>) == sizeof(I)
                                    ,tagged_idx_base<max_bits_v<T>, I, T>>;
 
+template <size_t tag_sz, typename I, typename T, typename E, typename H>
+struct hash<tagged_idx_base<tag_sz,I,T,E>,H> {
+
+	constexpr size_t operator()(const tagged_idx_base<tag_sz,I,T,E> &x) const noexcept
+	{
+		return H(x.v).v;
+	}
+};
+
 }
 
 #endif
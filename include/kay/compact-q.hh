@@ -0,0 +1,315 @@
+/*
+ * compact-q.hh
+ *
+ * Copyright 2018-2022 Franz Brauße <fb@paxle.org>
+ *
+ * See the LICENSE file for terms of distribution.
+ */
+
+#ifndef KAY_COMPACT_Q_HH
+#define KAY_COMPACT_Q_HH
+
+#include <cstdint>
+#include <cassert>
+#include <cmath>	/* std::fma, std::nextafter */
+#include <vector>
+#include <iterator>	/* std::random_access_iterator_tag */
+
+#include <kay/numbers.hh>
+
+namespace kay {
+
+namespace compact_detail {
+/* shadowed by the member in compact_Q_vector */
+inline int sign(const Q &q) { return sgn(q); }
+}
+
+/* Sequence of Q storing each value whose canonical numerator fits into an
+ * int32_t and whose denominator fits into an uint32_t in 8 bytes inline. The
+ * others are spilled to a side vector of Q; the inline cell of a spilled value
+ * holds its index there and a zero denominator. Slots of the side vector freed
+ * by overwriting or removing spilled values are reused.
+ *
+ * Elements are materialized as Q on access; references and iterators are
+ * proxies like those of packed_vector. */
+class compact_Q_vector {
+
+	struct cell {
+		int32_t num;
+		uint32_t den; /* 0: spilled, num is the index into spill */
+	};
+	static_assert(sizeof(cell) == 8);
+	static_assert(sizeof(int) == 4);
+
+	std::vector<cell> c;
+	std::vector<Q> spill;
+	std::vector<uint32_t> free_slots;
+
+	static bool small(const Q &q, cell &r)
+	{
+#if (KAY_USE_FLINT-0)
+		const fmpq *p = q.get_fmpq_t();
+		if (COEFF_IS_MPZ(p->num) || COEFF_IS_MPZ(p->den) ||
+		    p->num < INT32_MIN || p->num > INT32_MAX || (ulong)p->den > UINT32_MAX)
+			return false;
+		r = { (int32_t)p->num, (uint32_t)p->den };
+#else
+		if (!mpz_fits_sint_p(q.get_num_mpz_t()) || !mpz_fits_uint_p(q.get_den_mpz_t()))
+			return false;
+		r = { (int32_t)mpz_get_si(q.get_num_mpz_t()),
+		      (uint32_t)mpz_get_ui(q.get_den_mpz_t()) };
+#endif
+		return true;
+	}
+
+	static void load(Q &q, const cell &x)
+	{
+#if (KAY_USE_FLINT-0)
+		fmpq_set_si(q.get_fmpq_t(), x.num, x.den);
+#else
+		mpq_set_si(q.get_mpq_t(), x.num, x.den);
+#endif
+	}
+
+	static uint32_t slot_of(const cell &x) { return (uint32_t)x.num; }
+
+	/* num/den truncated like Q::get_d() in any rounding mode: the remainder
+	 * of the rounded quotient is exact, its sign tells whether the quotient
+	 * has to move towards zero */
+	static double trunc_div(int32_t num, uint32_t den)
+	{
+		double q = (double)num / den;
+		double r = std::fma(-q, (double)den, (double)num);
+		if (num > 0 ? r < 0 : r > 0)
+			q = std::nextafter(q, 0.0);
+		return q;
+	}
+
+	void release(cell &x)
+	{
+		if (x.den)
+			return;
+		uint32_t s = slot_of(x);
+		spill[s] = Q();
+		free_slots.push_back(s);
+	}
+
+	cell store(const Q &q)
+	{
+		cell r;
+		if (small(q, r))
+			return r;
+		uint32_t s;
+		if (!free_slots.empty()) {
+			s = free_slots.back();
+			free_slots.pop_back();
+			spill[s] = q;
+		} else {
+			assert(spill.size() < UINT32_MAX);
+			s = spill.size();
+			spill.push_back(q);
+		}
+		return { (int32_t)s, 0 };
+	}
+
+public:
+	class reference {
+		friend class compact_Q_vector;
+		compact_Q_vector *v;
+		size_t i;
+		reference(compact_Q_vector *v, size_t i) : v(v), i(i) {}
+	public:
+		operator Q() const { return v->get(i); }
+		reference & operator=(const Q &x) { v->set(i, x); return *this; }
+		reference & operator=(const reference &r) { return *this = (Q)r; }
+	};
+
+	template <bool is_const>
+	class iter {
+		friend class compact_Q_vector;
+		using V = std::conditional_t<is_const,const compact_Q_vector,compact_Q_vector>;
+		V *v;
+		size_t i;
+		iter(V *v, size_t i) : v(v), i(i) {}
+	public:
+		using iterator_category = std::random_access_iterator_tag;
+		using value_type        = Q;
+		using difference_type   = ptrdiff_t;
+		using pointer           = void;
+		using reference         = std::conditional_t<is_const,Q,compact_Q_vector::reference>;
+
+		iter() = default;
+		operator iter<true>() const { return { v, i }; }
+		reference operator*() const { return (*v)[i]; }
+		reference operator[](difference_type k) const { return (*v)[i + k]; }
+		iter & operator++() { ++i; return *this; }
+		iter & operator--() { --i; return *this; }
+		iter operator++(int) { iter r = *this; ++i; return r; }
+		iter operator--(int) { iter r = *this; --i; return r; }
+		iter & operator+=(difference_type k) { i += k; return *this; }
+		iter & operator-=(difference_type k) { i -= k; return *this; }
+		friend iter operator+(iter a, difference_type k) { return a += k; }
+		friend iter operator-(iter a, difference_type k) { return a -= k; }
+		friend difference_type operator-(const iter &a, const iter &b) { return a.i - b.i; }
+		friend bool operator==(const iter &a, const iter &b) { return a.i == b.i; }
+		friend bool operator!=(const iter &a, const iter &b) { return a.i != b.i; }
+		friend bool operator< (const iter &a, const iter &b) { return a.i <  b.i; }
+	};
+
+	using iterator = iter<false>;
+	using const_iterator = iter<true>;
+
+	compact_Q_vector() = default;
+	explicit compact_Q_vector(size_t n, const Q &v = Q()) { resize(n, v); }
+
+	template <typename It>
+	compact_Q_vector(It first, It last) { assign(first, last); }
+
+	explicit compact_Q_vector(const std::vector<Q> &v) : compact_Q_vector(v.begin(), v.end()) {}
+
+	template <typename It>
+	void assign(It first, It last)
+	{
+		clear();
+		if constexpr (std::is_base_of_v<std::forward_iterator_tag,
+		                                typename std::iterator_traits<It>::iterator_category>)
+			reserve(std::distance(first, last));
+		for (; first != last; ++first)
+			push_back(*first);
+	}
+
+	size_t size() const { return c.size(); }
+	bool empty() const { return c.empty(); }
+
+	/* number of spilled elements */
+	size_t spilled() const { return spill.size() - free_slots.size(); }
+
+	void reserve(size_t k) { c.reserve(k); }
+
+	void clear()
+	{
+		c.clear();
+		spill.clear();
+		free_slots.clear();
+	}
+
+	void resize(size_t k, const Q &v = Q())
+	{
+		while (c.size() > k)
+			pop_back();
+		if (c.size() < k) {
+			cell x = store(v);
+			if (x.den)
+				c.resize(k, x);
+			else {
+				c.push_back(x);
+				while (c.size() < k)
+					c.push_back(store(v));
+			}
+		}
+	}
+
+	void push_back(const Q &v) { c.push_back(store(v)); }
+	void pop_back() { assert(!empty()); release(c.back()); c.pop_back(); }
+
+	/* whether element i is stored inline */
+	bool is_inline(size_t i) const { assert(i < size()); return c[i].den; }
+
+	Q get(size_t i) const
+	{
+		assert(i < size());
+		const cell &x = c[i];
+		if (!x.den)
+			return spill[slot_of(x)];
+		Q r;
+		load(r, x);
+		return r;
+	}
+
+	void get(size_t i, Q &r) const
+	{
+		assert(i < size());
+		const cell &x = c[i];
+		if (x.den)
+			load(r, x);
+		else
+			r = spill[slot_of(x)];
+	}
+
+	void set(size_t i, const Q &v)
+	{
+		assert(i < size());
+		cell x;
+		if (!c[i].den && !small(v, x)) {
+			spill[slot_of(c[i])] = v;
+			return;
+		}
+		release(c[i]);
+		c[i] = store(v);
+	}
+
+	/* the value of element i truncated towards zero, as by Q::get_d() */
+	double get_d(size_t i) const
+	{
+		assert(i < size());
+		const cell &x = c[i];
+		return x.den ? trunc_div(x.num, x.den) : spill[slot_of(x)].get_d();
+	}
+
+	int sgn(size_t i) const
+	{
+		assert(i < size());
+		const cell &x = c[i];
+		return x.den ? (x.num > 0) - (x.num < 0) : compact_detail::sign(spill[slot_of(x)]);
+	}
+
+	Q operator[](size_t i) const { return get(i); }
+	reference operator[](size_t i) { return { this, i }; }
+
+	Q front() const { return get(0); }
+	Q back() const { return get(size()-1); }
+
+	iterator begin() { return { this, 0 }; }
+	iterator end() { return { this, size() }; }
+	const_iterator begin() const { return { this, 0 }; }
+	const_iterator end() const { return { this, size() }; }
+
+	/* materializes the elements [first,first+k) into out */
+	void get(size_t first, size_t k, Q *out) const
+	{
+		assert(first + k <= size());
+		for (; k; k--)
+			get(first++, *out++);
+	}
+
+	std::vector<Q> to_vector() const
+	{
+		std::vector<Q> r(size());
+		get(0, size(), r.data());
+		return r;
+	}
+
+	/* canonical values are stored inline if and only if they fit */
+	friend bool operator==(const compact_Q_vector &a, const compact_Q_vector &b)
+	{
+		if (a.size() != b.size())
+			return false;
+		for (size_t i=0; i<a.size(); i++) {
+			const cell &x = a.c[i], &y = b.c[i];
+			if (x.den != y.den)
+				return false;
+			if (x.den ? x.num != y.num : a.spill[slot_of(x)] != b.spill[slot_of(y)])
+				return false;
+		}
+		return true;
+	}
+
+	friend bool operator!=(const compact_Q_vector &a, const compact_Q_vector &b)
+	{
+		return !(a == b);
+	}
+};
+
+}
+
+#endif
@@ -10,10 +10,18 @@
 #ifndef KAY_COMPILETIME_HH
 #define KAY_COMPILETIME_HH
 
+#include <cstdint>
+#include <cstddef>	/* size_t */
+#include <array>
+#include <utility>	/* std::integer_sequence */
+#include <type_traits>
+#include <stdexcept>	/* std::overflow_error, std::domain_error */
+
 namespace kay::compiletime {
 
-/* contains strings termed 'L' (using namespace limbs) and arbitrary sized
- * natural numbers (using namespace N) */
+/* contains strings termed 'L' (using namespace limbs), natural numbers of
+ * fixed capacity as constexpr values (nat<K>) and arbitrary sized natural
+ * numbers as types (using namespace N) */
 
 /* --------------------------------------------------------------------------
  * strings over alphabet uint64_t
@@ -81,6 +89,368 @@ template <> struct ileave2<L<>,L<>> {
 
 }
 
+/* --------------------------------------------------------------------------
+ * natural numbers of fixed capacity K limbs, usable in constant expressions
+ * -------------------------------------------------------------------------- */
+
+/* All operations throw std::overflow_error when the result does not fit into
+ * K limbs, which in constant expressions is a compile-time error. */
+template <size_t K>
+class nat {
+
+	template <size_t> friend class nat;
+
+	using u128 = unsigned __int128;
+
+	std::array<uint64_t,K> l {}; /* little-endian */
+
+	static constexpr void overflow()
+	{
+		throw std::overflow_error("kay::compiletime::nat: capacity exceeded");
+	}
+
+	/* a += m*b << 64*i, returns whether the result did not fit */
+	static constexpr bool addmul1(std::array<uint64_t,K> &a, const nat &b,
+	                              uint64_t m, size_t i)
+	{
+		if (!m)
+			return false;
+		u128 c = 0;
+		size_t j = 0;
+		for (; i+j < K; j++) {
+			c += (u128)b.l[j] * m + a[i+j];
+			a[i+j] = c;
+			c >>= 64;
+		}
+		if (c)
+			return true;
+		/* all limbs of b shifted beyond K must be zero */
+		for (; j<K; j++)
+			if (b.l[j])
+				return true;
+		return false;
+	}
+
+public:
+	static constexpr size_t capacity = K;
+
+	constexpr nat() = default;
+
+	constexpr nat(uint64_t v)
+	{
+		if constexpr (K > 0)
+			l[0] = v;
+		else if (v)
+			overflow();
+	}
+
+	explicit constexpr nat(const std::array<uint64_t,K> &limbs) : l(limbs) {}
+
+	template <size_t L>
+	explicit constexpr nat(const nat<L> &v)
+	{
+		for (size_t i=0; i<L; i++)
+			if (i < K)
+				l[i] = v.l[i];
+			else if (v.l[i])
+				overflow();
+	}
+
+	/* limb i, 0 for i >= K */
+	constexpr uint64_t operator[](size_t i) const { return i < K ? l[i] : 0; }
+
+	/* number of limbs without leading zeroes */
+	constexpr size_t size() const
+	{
+		size_t n = K;
+		while (n && !l[n-1])
+			n--;
+		return n;
+	}
+
+	constexpr bool bit(size_t i) const
+	{
+		return i / 64 < K && (l[i/64] >> (i % 64) & 1);
+	}
+
+	explicit constexpr operator bool() const { return size(); }
+
+	friend constexpr size_t bits(const nat &a)
+	{
+		size_t n = a.size();
+		return n ? 64 * n - __builtin_clzll(a.l[n-1]) : 0;
+	}
+
+	/* requires a != 0 */
+	friend constexpr size_t ctz(const nat &a)
+	{
+		size_t i = 0;
+		while (!a.l[i])
+			i++;
+		return 64 * i + __builtin_ctzll(a.l[i]);
+	}
+
+	friend constexpr int cmp(const nat &a, const nat &b)
+	{
+		for (size_t i=K; i--;)
+			if (a.l[i] != b.l[i])
+				return a.l[i] < b.l[i] ? -1 : +1;
+		return 0;
+	}
+
+	friend constexpr bool operator==(const nat &a, const nat &b) { return cmp(a, b) == 0; }
+	friend constexpr bool operator!=(const nat &a, const nat &b) { return cmp(a, b) != 0; }
+	friend constexpr bool operator< (const nat &a, const nat &b) { return cmp(a, b) <  0; }
+	friend constexpr bool operator<=(const nat &a, const nat &b) { return cmp(a, b) <= 0; }
+	friend constexpr bool operator> (const nat &a, const nat &b) { return cmp(a, b) >  0; }
+	friend constexpr bool operator>=(const nat &a, const nat &b) { return cmp(a, b) >= 0; }
+
+	friend constexpr nat & operator+=(nat &a, const nat &b)
+	{
+		bool c = false;
+		for (size_t i=0; i<K; i++) {
+			uint64_t s = a.l[i] + b.l[i];
+			bool c2 = s < a.l[i];
+			a.l[i] = s + c;
+			c = c2 || a.l[i] < s;
+		}
+		if (c)
+			overflow();
+		return a;
+	}
+	friend constexpr nat   operator+ (nat  a, const nat &b) { a += b; return a; }
+
+	/* requires a >= b */
+	friend constexpr nat & operator-=(nat &a, const nat &b)
+	{
+		bool c = false;
+		for (size_t i=0; i<K; i++) {
+			uint64_t d = a.l[i] - b.l[i];
+			bool c2 = a.l[i] < b.l[i];
+			a.l[i] = d - c;
+			c = c2 || d < (uint64_t)c;
+		}
+		if (c)
+			throw std::domain_error("kay::compiletime::nat: negative difference");
+		return a;
+	}
+	friend constexpr nat   operator- (nat  a, const nat &b) { a -= b; return a; }
+
+	friend constexpr nat & operator*=(nat &a, uint64_t m)
+	{
+		u128 c = 0;
+		for (size_t i=0; i<K; i++) {
+			c += (u128)a.l[i] * m;
+			a.l[i] = c;
+			c >>= 64;
+		}
+		if (c)
+			overflow();
+		return a;
+	}
+	friend constexpr nat   operator* (nat  a, uint64_t m) { a *= m; return a; }
+
+	/* schoolbook multiplication r = a*b, returns whether the product did not
+	 * fit, in which case r is unspecified */
+	friend constexpr bool mul_overflow(const nat &a, const nat &b, nat &r)
+	{
+		nat t;
+		for (size_t i=0; i<K; i++)
+			if (addmul1(t.l, b, a.l[i], i))
+				return true;
+		r = t;
+		return false;
+	}
+
+	friend constexpr nat   operator* (const nat &a, const nat &b)
+	{
+		nat r;
+		if (mul_overflow(a, b, r))
+			overflow();
+		return r;
+	}
+	friend constexpr nat & operator*=(nat &a, const nat &b) { a = a * b; return a; }
+
+	friend constexpr nat & operator<<=(nat &a, size_t n)
+	{
+		if (!a)
+			return a;
+		if (bits(a) + n > 64 * K)
+			overflow();
+		size_t w = n / 64, b = n % 64;
+		for (size_t i=K; i-- > w;)
+			a.l[i] = a.l[i-w] << b | (b && i > w ? a.l[i-w-1] >> (64 - b) : 0);
+		for (size_t i=0; i<w; i++)
+			a.l[i] = 0;
+		return a;
+	}
+	friend constexpr nat   operator<< (nat  a, size_t n) { a <<= n; return a; }
+
+	friend constexpr nat & operator>>=(nat &a, size_t n)
+	{
+		size_t w = n / 64, b = n % 64;
+		for (size_t i=0; i<K; i++)
+			a.l[i] = i+w < K ? a.l[i+w] >> b | (b && i+w+1 < K ? a.l[i+w+1] << (64 - b) : 0) : 0;
+		return a;
+	}
+	friend constexpr nat   operator>> (nat  a, size_t n) { a >>= n; return a; }
+
+	struct divmod_result;
+
+	/* quotient and remainder, Knuth, TAOCP vol. 2, 4.3.1, Algorithm D */
+	friend constexpr divmod_result divmod(const nat &a, const nat &b)
+	{
+		size_t n = b.size(), m = a.size();
+		if (!n)
+			throw std::domain_error("kay::compiletime::nat: division by zero");
+		divmod_result r {};
+		if (m < n) {
+			r.r = a;
+			return r;
+		}
+		if (n == 1) {
+			u128 c = 0;
+			for (size_t i=m; i--;) {
+				c = c << 64 | a.l[i];
+				r.q.l[i] = c / b.l[0];
+				c %= b.l[0];
+			}
+			r.r.l[0] = c;
+			return r;
+		}
+		/* normalize such that the leading bit of v is set */
+		unsigned s = __builtin_clzll(b.l[n-1]);
+		std::array<uint64_t,K+1> u {};
+		std::array<uint64_t,K> v {};
+		for (size_t i=0; i<n; i++)
+			v[i] = b.l[i] << s | (s && i ? b.l[i-1] >> (64 - s) : 0);
+		for (size_t i=0; i<m; i++)
+			u[i] = a.l[i] << s | (s && i ? a.l[i-1] >> (64 - s) : 0);
+		u[m] = s ? a.l[m-1] >> (64 - s) : 0;
+		for (size_t j=m-n+1; j--;) {
+			u128 num = (u128)u[j+n] << 64 | u[j+n-1];
+			u128 qh = num / v[n-1], rh = num % v[n-1];
+			while (qh >> 64 || qh * v[n-2] > (rh << 64 | u[j+n-2])) {
+				qh--;
+				rh += v[n-1];
+				if (rh >> 64)
+					break;
+			}
+			/* u[j..j+n] -= qh * v */
+			u128 c = 0;
+			bool br = false;
+			for (size_t i=0; i<=n; i++) {
+				c += i < n ? qh * v[i] : 0;
+				uint64_t p = c, x = u[i+j];
+				c >>= 64;
+				u[i+j] = x - p - br;
+				br = x < p || (x == p && br);
+			}
+			if (br) {
+				/* qh was one too large, add back */
+				qh--;
+				bool cy = false;
+				for (size_t i=0; i<=n; i++) {
+					uint64_t y = i < n ? v[i] : 0, x = u[i+j];
+					u[i+j] = x + y + cy;
+					cy = u[i+j] < x || (cy && u[i+j] == x);
+				}
+			}
+			r.q.l[j] = qh;
+		}
+		for (size_t i=0; i<n; i++)
+			r.r.l[i] = u[i] >> s | (s ? u[i+1] << (64 - s) : 0);
+		return r;
+	}
+
+	friend constexpr nat & operator/=(nat &a, const nat &b) { a = divmod(a, b).q; return a; }
+	friend constexpr nat   operator/ (nat  a, const nat &b) { a /= b; return a; }
+
+	friend constexpr nat & operator%=(nat &a, const nat &b) { a = divmod(a, b).r; return a; }
+	friend constexpr nat   operator% (nat  a, const nat &b) { a %= b; return a; }
+
+	/* binary gcd, gcd(0,0) = 0 */
+	friend constexpr nat gcd(nat a, nat b)
+	{
+		if (!a)
+			return b;
+		if (!b)
+			return a;
+		size_t za = ctz(a), zb = ctz(b);
+		a >>= za;
+		b >>= zb;
+		for (;;) {
+			/* a and b are odd */
+			if (a > b) {
+				nat t = a;
+				a = b;
+				b = t;
+			}
+			b -= a;
+			if (!b)
+				return a << (za < zb ? za : zb);
+			b >>= ctz(b);
+		}
+	}
+
+	friend constexpr nat pow(nat a, unsigned long e)
+	{
+		nat r = 1;
+		for (; e; e >>= 1) {
+			if (e & 1)
+				r *= a;
+			if (e > 1)
+				a *= a;
+		}
+		return r;
+	}
+};
+
+template <size_t K>
+struct nat<K>::divmod_result { nat q, r; };
+
+/* product with sufficient capacity */
+template <size_t K, size_t L>
+constexpr nat<K+L> mul_full(const nat<K> &a, const nat<L> &b)
+{
+	return nat<K+L>(a) * nat<K+L>(b);
+}
+
+namespace detail {
+template <size_t K>
+constexpr bool mul_overflows(const nat<K> &a, const nat<K> &b)
+{
+	nat<K> r;
+	return mul_overflow(a, b, r);
+}
+}
+
+static_assert(!detail::mul_overflows(nat<3>(1) << 64, nat<3>(1) << 127));
+static_assert( detail::mul_overflows(nat<3>(1) << 64, nat<3>(1) << 128));
+static_assert( detail::mul_overflows(nat<3>(1) << 128, nat<3>(1) << 128));
+static_assert( detail::mul_overflows(nat<3>(1) << 128, nat<3>(1) << 64));
+static_assert( detail::mul_overflows(nat<3>(3) << 128, (nat<3>(1) << 128) + 1));
+static_assert( detail::mul_overflows(nat<3>(2), nat<3>(1) << 191));
+static_assert( detail::mul_overflows(nat<3>(UINT64_MAX) << 64, nat<3>(UINT64_MAX) << 64));
+static_assert(!detail::mul_overflows(nat<4>(UINT64_MAX) << 64, nat<4>(UINT64_MAX) << 64));
+static_assert((nat<4>(1) << 128) * (nat<4>(1) << 127) == nat<4>(1) << 255);
+static_assert(mul_full(nat<3>(1) << 128, nat<3>(1) << 128) == nat<6>(1) << 256);
+
+/* sum with sufficient capacity */
+template <size_t K, size_t L>
+constexpr nat<(K > L ? K : L)+1> add_full(const nat<K> &a, const nat<L> &b)
+{
+	using R = nat<(K > L ? K : L)+1>;
+	return R(a) + R(b);
+}
+
+/* conversion of limb strings to values */
+template <uint64_t... As>
+constexpr nat<sizeof...(As)> to_nat(limbs::L<As...>)
+{
+	return nat<sizeof...(As)>(std::array<uint64_t,sizeof...(As)> { As... });
+}
+
 /* --------------------------------------------------------------------------
  * notation of natural numbers using limbs (strings over alphabet size_t)
  * -------------------------------------------------------------------------- */
@@ -109,54 +479,37 @@ namespace detail {
 
 using namespace limbs;
 
-template <uint64_t n, typename A> struct strip_leading_0_rev;
-template <uint64_t n, typename A> using strip_leading_0_rev_t = typename strip_leading_0_rev<n,A>::type;
-template <> struct strip_leading_0_rev<0,L<>> {
-	using type = L<>;
-};
-template <uint64_t n, uint64_t... As> struct strip_leading_0_rev<n,L<As...>> {
-	using type = concat1_t<n,L<As...>>;
+/* from_value: the limb string of the constexpr nat F::value without leading
+ * zeroes */
+template <typename F, typename Is> struct from_value;
+template <typename F, size_t... Is> struct from_value<F,std::index_sequence<Is...>> {
+	using type = L<F::value[Is]...>;
 };
+template <typename F> using from_value_t =
+	typename from_value<F,std::make_index_sequence<F::value.size()>>::type;
 
-template <typename A> struct strip_leading_0;
-template <typename A> using strip_leading_0_t = typename strip_leading_0<A>::type;
-template <uint64_t n, uint64_t... As> struct strip_leading_0<L<n,As...>> {
-	using type = strip_leading_0_rev_t<n,strip_leading_0_t<L<As...>>>;
-};
-template <> struct strip_leading_0<L<>> {
-	using type = L<>;
+template <uint64_t... As> struct nat_of {
+	static constexpr nat<sizeof...(As)> value { std::array<uint64_t,sizeof...(As)> { As... } };
 };
 
 }
 
 /* N: a natural number is a string of limbs with leading zeroes stripped */
-template <uint64_t... As> using N = detail::strip_leading_0_t<limbs::L<As...>>;
+template <uint64_t... As> using N = detail::from_value_t<detail::nat_of<As...>>;
 
 namespace detail {
 
 static_assert(std::is_same_v<N<0,0>,L<>>);
 static_assert(std::is_same_v<N<1,0,0>,L<1>>);
 
-/* iadd: addition of two interleaved natural numbers */
-template <bool carry, typename A> struct iadd;
-template <bool carry, typename A> using iadd_t = typename iadd<carry,A>::type;
-template <bool carry, uint64_t A, uint64_t B, uint64_t... Cs> struct iadd<carry,L<A,B,Cs...>> {
-	using type = concat1_t<A+B+carry,iadd_t<(A+B<A || A+B+carry<A+B),L<Cs...>>>;
-};
-template <uint64_t C> struct iadd<false,L<C>> {
-	using type = L<C>;
-};
-template <> struct iadd<false,L<>> {
-	using type = L<>;
-};
-template <> struct iadd<true,L<>> {
-	using type = L<1>;
+template <typename A, typename B> struct add {
+	static constexpr auto value = add_full(to_nat(A{}), to_nat(B{}));
 };
 
 }
 
 /* add: addition of two natural numbers represented by strings */
-template <typename A, typename B> using add_t = detail::iadd_t<false,limbs::ileave2_t<A,B>>;
+template <typename A, typename B> using add_t = detail::from_value_t<detail::add<A,B>>;
 
 static_assert(std::is_same_v<add_t<N<>                     ,N<>              >,N<>          >);
 static_assert(std::is_same_v<add_t<N<0,1>                  ,N<3>             >,N<3,1>       >);
@@ -181,32 +534,14 @@ static_assert(N<1>{} + N<2>{} == N<3,0,0,0,0>{});
 
 namespace detail {
 
-/* mul1: multiply limb by natural number */
-template <uint64_t a, typename B> struct imul1;
-template <uint64_t a, typename B> using imul1_t = typename imul1<a,B>::type;
-template <uint64_t a> struct imul1<a,L<>> {
-	using type = N<>;
+/* mul: multiply natural numbers */
+template <typename A, typename B> struct mul {
+	static constexpr auto value = mul_full(to_nat(A{}), to_nat(B{}));
 };
-template <uint64_t a, uint64_t b, uint64_t... Bs> struct imul1<a,L<b,Bs...>> {
-private:
-	static constexpr uint64_t lo(uint64_t v) { return v & 0xffff'ffff; }
-	static constexpr uint64_t hi(uint64_t v) { return v >> 32; }
-
-	/* largest value (B-1)^2 = B^2-2B+1 for B=2^32 */
-	static constexpr uint64_t ll = lo(a) * lo(b);
-	static constexpr uint64_t lh = lo(a) * hi(b);
-	static constexpr uint64_t hl = hi(a) * lo(b);
-	static constexpr uint64_t hh = hi(a) * hi(b);
-
-	/* no overflows in intermediate sums */
-	static constexpr uint64_t x = hl + hi(ll); /* B^2-2B+1 + (B-1) = B^2-B */
-	static constexpr uint64_t y = lo(x) + lh;  /* (B-1) + B^2-2B+1 = B^2-B */
-	static constexpr uint64_t c = hi(x) + hi(y) + hh; /* 2(B-1) + B^2-2B+1 = B^2-1 */
-	static constexpr uint64_t r = lo(ll) | lo(y) << 32;
+template <typename A, typename B> using mul_t = from_value_t<mul<A,B>>;
 
-public:
-	using type = concat1_t<r,add_t<N<c>,imul1_t<a,L<Bs...>>>>;
-};
+/* mul1: multiply limb by natural number */
+template <uint64_t a, typename B> using imul1_t = mul_t<N<a>,B>;
 
 static_assert(std::is_same_v<imul1_t<2,N<1>>,N<2>>);
 static_assert(std::is_same_v<imul1_t<UINT64_MAX,N<2>>,N<(UINT64_MAX << 1),1>>);
@@ -217,16 +552,6 @@ static_assert(std::is_same_v<imul1_t<(1ULL<<63),N<UINT64_MAX>>,N<(UINT64_MAX <<
 static_assert(std::is_same_v<imul1_t<UINT64_MAX,N<UINT64_MAX>>,N<1,UINT64_MAX-1>>);
 static_assert(std::is_same_v<imul1_t<UINT64_MAX,N<UINT64_MAX,UINT64_MAX>>,N<1,UINT64_MAX,UINT64_MAX-1>>);
 
-/* mul: multiply natural numbers (schoolbook) */
-template <typename A, typename B> struct mul;
-template <typename A, typename B> using mul_t = typename mul<A,B>::type;
-template <typename B> struct mul<L<>,B> {
-	using type = N<>;
-};
-template <uint64_t a, uint64_t... As, typename B> struct mul<L<a,As...>,B> {
-	using type = add_t<imul1_t<a,B>,concat1_t<0,mul_t<L<As...>,B>>>;
-};
-
 }
 
 using detail::mul_t;
@@ -249,21 +574,16 @@ enum class cmp { LT = -1, EQ = 0, GT = +1 };
 
 namespace detail {
 
-template <uint64_t a, uint64_t b, cmp c> struct icmp_merge
-: std::integral_constant<cmp,c> {};
-template <uint64_t a, uint64_t b> struct icmp_merge<a,b,cmp::EQ> {
-	static constexpr cmp value = a < b ? cmp::LT : a > b ? cmp::GT : cmp::EQ;
-};
-
-template <typename A> struct icmp;
-template <typename A> static constexpr cmp icmp_v = icmp<A>::value;
-template <> struct icmp<L<>> : std::integral_constant<cmp,cmp::EQ> {};
-template <uint64_t a, uint64_t b, uint64_t... Cs> struct icmp<L<a,b,Cs...>>
-: icmp_merge<a,b,icmp_v<L<Cs...>>> {};
+template <typename A, typename B>
+constexpr cmp cmp_nat(const A &a, const B &b)
+{
+	using R = nat<(A::capacity > B::capacity ? A::capacity : B::capacity)>;
+	return R(a) < R(b) ? cmp::LT : R(a) > R(b) ? cmp::GT : cmp::EQ;
+}
 
 }
 
-template <typename A, typename B> static constexpr cmp cmp_v = detail::icmp_v<limbs::ileave2_t<A,B>>;
+template <typename A, typename B> static constexpr cmp cmp_v = detail::cmp_nat(to_nat(A{}), to_nat(B{}));
 
 static_assert(cmp_v<N<1,2>,N<2,1>> == cmp::GT);
 static_assert(cmp_v<N<>,N<>> == cmp::EQ);
@@ -0,0 +1,199 @@
+/*
+ * dbl-const.hh
+ *
+ * Copyright 2018-2022 Franz Brauße <fb@paxle.org>
+ *
+ * See the LICENSE file for terms of distribution.
+ */
+
+#ifndef KAY_DBL_CONST_HH
+#define KAY_DBL_CONST_HH
+
+#include <stdexcept>	/* std::domain_error */
+#include <kay/dbl-ival.hh>
+#include <kay/compiletime.hh>
+
+namespace kay::dbl {
+
+/* compile-time tight enclosures of constants */
+
+namespace detail {
+
+using compiletime::nat;
+
+constexpr int bitlen(uint64_t v) { return v ? 64 - __builtin_clzll(v) : 0; }
+
+/* f*2^e for f <= 2^53, which is exact unless overflowing */
+constexpr double ldexp_exact(uint64_t f, int e)
+{
+	if (!f)
+		return 0;
+	if (e + bitlen(f) > DBL_MAX_EXP)
+		return INFINITY;
+	double r = f;
+	for (; e >= 64; e -= 64)
+		r *= 0x1p64;
+	for (; e > 0; e--)
+		r *= 2;
+	for (; e <= -64; e += 64)
+		r *= 0x1p-64;
+	for (; e < 0; e++)
+		r /= 2;
+	return r;
+}
+
+/* tightest enclosure of num/den */
+template <size_t K1, size_t K2>
+constexpr endpts rat_enc(const nat<K1> &num, const nat<K2> &den)
+{
+	constexpr size_t K = (K1 > K2 ? K1 : K2) + 1;
+	nat<K> n(num), d(den);
+	if (!d)
+		throw std::domain_error("division by zero");
+	if (!n)
+		return { 0, 0 };
+	/* 2^(e-1) < n/d < 2^(e+1) */
+	int e = (int)bits(n) - (int)bits(d);
+	if (e < DBL_MIN_EXP - DBL_MANT_DIG - 1)
+		return { 0, std::numeric_limits<double>::denorm_min() };
+	if (e > DBL_MAX_EXP)
+		return { DBL_MAX, INFINITY };
+	int scale = std::max(e - DBL_MANT_DIG, DBL_MIN_EXP - DBL_MANT_DIG);
+	if (scale >= 0)
+		d <<= scale;
+	else
+		n <<= -scale;
+	/* the quotient has at most 54 bits */
+	auto [q, r] = divmod(n, d);
+	uint64_t f = q[0];
+	bool sticky = (bool)r;
+	if (f >> DBL_MANT_DIG) {
+		sticky |= f & 1;
+		f >>= 1;
+		scale++;
+	}
+	double l = ldexp_exact(f, scale);
+	return { l == INFINITY ? DBL_MAX : l, ldexp_exact(f + sticky, scale) };
+}
+
+/* Fixed-point approximations v of constants c with K-1 fractional limbs and
+ * an error bound: |v - c*2^(64*(K-1))| <= err. */
+template <size_t K>
+struct fixpt {
+	nat<K> v;
+	uint64_t err;
+};
+
+template <size_t K>
+constexpr nat<K> fixpt_one()
+{
+	return nat<K>(1) << 64 * (K-1);
+}
+
+/* sum_k s^k / ((2k+1) x^(2k+1)) for s = -1 (atan) and s = +1 (atanh) */
+template <size_t K>
+constexpr fixpt<K> atan_inv(uint64_t x, bool hyperbolic)
+{
+	fixpt<K> r {};
+	nat<K> p = fixpt_one<K>() / x;
+	for (uint64_t k=0; p; k++) {
+		nat<K> t = p / (2*k+1);
+		if (k % 2 && !hyperbolic)
+			r.v -= t;
+		else
+			r.v += t;
+		/* floors in p and t */
+		r.err += 3;
+		p /= x*x;
+	}
+	/* tail */
+	r.err += 3;
+	return r;
+}
+
+template <size_t K>
+constexpr fixpt<K> scale(uint64_t a, const fixpt<K> &x)
+{
+	return { x.v * a, a * x.err };
+}
+
+/* a*x + b*y, requires the result to be non-negative */
+template <size_t K>
+constexpr fixpt<K> lin_comb(uint64_t a, const fixpt<K> &x, int64_t b, const fixpt<K> &y)
+{
+	fixpt<K> r = scale(a, x);
+	uint64_t m = b < 0 ? -(uint64_t)b : b;
+	if (b >= 0)
+		r.v += y.v * m;
+	else
+		r.v -= y.v * m;
+	r.err += m * y.err;
+	return r;
+}
+
+template <size_t K>
+constexpr fixpt<K> fixpt_e()
+{
+	/* sum_k 1/k! */
+	fixpt<K> r {};
+	nat<K> t = fixpt_one<K>();
+	for (uint64_t k=1; t; k++) {
+		r.v += t;
+		t /= k;
+		r.err += 2;
+	}
+	r.err += 4;
+	return r;
+}
+
+template <size_t K>
+constexpr ival fixpt_enc(const fixpt<K> &c)
+{
+	nat<K> l = c.v - c.err, u = c.v + c.err;
+	return endpts { rat_enc(l, fixpt_one<K>()).l, rat_enc(u, fixpt_one<K>()).u };
+}
+
+/* 192 fractional bits */
+constexpr size_t const_limbs = 4;
+
+} /* namespace detail */
+
+/* Tightest enclosure of the rational number P/Q, both of which are natural
+ * numbers in the notation of kay::compiletime::N. */
+template <typename P, typename Q = compiletime::N::N<1>>
+inline constexpr ival rat_v = detail::rat_enc(compiletime::to_nat(P{}),
+                                              compiletime::to_nat(Q{}));
+
+/* tightest enclosure of p/q */
+constexpr ival rat(int64_t p, uint64_t q)
+{
+	ival r = detail::rat_enc(detail::nat<1>(p < 0 ? -(uint64_t)p : p),
+	                         detail::nat<1>(q));
+	return p < 0 ? -r : r;
+}
+
+namespace constants {
+
+using detail::const_limbs;
+
+/* 16 atan(1/5) - 4 atan(1/239) */
+inline constexpr ival pi = detail::fixpt_enc(detail::lin_comb(
+	16, detail::atan_inv<const_limbs>(5, false),
+	-4, detail::atan_inv<const_limbs>(239, false)));
+
+inline constexpr ival e = detail::fixpt_enc(detail::fixpt_e<const_limbs>());
+
+/* 2 atanh(1/3) */
+inline constexpr ival ln2 = detail::fixpt_enc(detail::scale(
+	2, detail::atan_inv<const_limbs>(3, true)));
+
+/* 3 ln 2 + ln(5/4) = 6 atanh(1/3) + 2 atanh(1/9) */
+inline constexpr ival ln10 = detail::fixpt_enc(detail::lin_comb(
+	6, detail::atan_inv<const_limbs>(3, true),
+	2, detail::atan_inv<const_limbs>(9, true)));
+
+}
+
+}
+
+#endif
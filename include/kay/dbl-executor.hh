@@ -0,0 +1,304 @@
+/*
+ * dbl-executor.hh
+ *
+ * Copyright 2018-2022 Franz Brauße <fb@paxle.org>
+ *
+ * See the LICENSE file for terms of distribution.
+ */
+
+#ifndef KAY_DBL_EXECUTOR_HH
+#define KAY_DBL_EXECUTOR_HH
+
+#include <cfenv>	/* fesetround() */
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <memory>	/* std::unique_ptr */
+#include <optional>
+#include <exception>	/* std::exception_ptr */
+#include <iterator>	/* std::iterator_traits */
+#include <type_traits>
+#include <algorithm>	/* std::min, std::max */
+
+#include <kay/dbl-ival.hh>	/* rounding_mode */
+
+namespace kay::dbl {
+
+/* Callback to be run in round-to-nearest instead of FE_DOWNWARD. */
+template <typename F>
+struct round_nearest {
+	F f;
+};
+
+template <typename F>
+round_nearest<std::decay_t<F>> nearest(F &&f) { return { std::forward<F>(f) }; }
+
+/* Pool of threads for interval computations. The workers set FE_DOWNWARD once
+ * when they start and keep it; the thread calling parallel_for() or
+ * parallel_reduce() takes part in the work and is switched to FE_DOWNWARD once
+ * per call. Callbacks wrapped by nearest() run in round-to-nearest.
+ *
+ * The index range is divided evenly among the participating threads. Each
+ * takes chunks of 'grain' indices from the front of its part; one that has run
+ * out steals the back half of another's remainder. Calls from within a
+ * callback run serially on the calling thread. Calls from different threads
+ * are serialized. The first exception thrown by a callback stops the
+ * distribution of further chunks and is rethrown to the caller. */
+class executor {
+
+	struct alignas(64) part {
+		std::mutex m;
+		size_t b = 0, e = 0;
+	};
+
+	struct job {
+		void (*body)(void *ctx, size_t b, size_t e, unsigned p);
+		void *ctx;
+		size_t grain;
+		bool nearest;
+		std::atomic<bool> failed;
+		std::mutex err_m;
+		std::exception_ptr err;
+	};
+
+	std::vector<std::thread> workers;
+	std::unique_ptr<part[]> parts;
+	std::mutex run_m; /* serializes jobs */
+	std::mutex m;
+	std::condition_variable cv, done_cv;
+	uint64_t gen = 0;
+	unsigned active = 0;
+	bool stop = false;
+	job *cur = nullptr;
+
+	static inline thread_local bool in_task = false;
+
+	bool take(unsigned p, size_t grain, size_t &b, size_t &e)
+	{
+		part &x = parts[p];
+		std::lock_guard<std::mutex> lock(x.m);
+		if (x.b == x.e)
+			return false;
+		b = x.b;
+		e = x.b = std::min(x.b + grain, x.e);
+		return true;
+	}
+
+	bool steal(unsigned p, size_t grain, size_t &b, size_t &e)
+	{
+		unsigned n = size();
+		for (unsigned k=1; k<n; k++) {
+			part &v = parts[(p + k) % n];
+			std::unique_lock<std::mutex> lock(v.m);
+			size_t len = v.e - v.b;
+			if (!len)
+				continue;
+			if (len <= grain) {
+				b = v.b;
+				e = v.b = v.e;
+				return true;
+			}
+			size_t mid = v.b + len / 2, end = v.e;
+			v.e = mid;
+			lock.unlock();
+			{
+				std::lock_guard<std::mutex> own(parts[p].m);
+				parts[p].b = mid;
+				parts[p].e = end;
+			}
+			return take(p, grain, b, e);
+		}
+		return false;
+	}
+
+	void participate(job &j, unsigned p)
+	{
+		in_task = true;
+		size_t b, e;
+		while (!j.failed.load(std::memory_order_relaxed) &&
+		       (take(p, j.grain, b, e) || steal(p, j.grain, b, e))) {
+			try {
+				j.body(j.ctx, b, e, p);
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(j.err_m);
+				if (!j.err)
+					j.err = std::current_exception();
+				j.failed = true;
+			}
+		}
+		in_task = false;
+	}
+
+	void loop(unsigned p)
+	{
+		fesetround(FE_DOWNWARD);
+		uint64_t seen = 0;
+		for (;;) {
+			job *j;
+			{
+				std::unique_lock<std::mutex> lock(m);
+				cv.wait(lock, [&]{ return stop || gen != seen; });
+				if (stop)
+					return;
+				seen = gen;
+				j = cur;
+			}
+			if (j->nearest) {
+				rounding_mode rnd(FE_TONEAREST);
+				participate(*j, p);
+			} else
+				participate(*j, p);
+			std::lock_guard<std::mutex> lock(m);
+			if (!--active)
+				done_cv.notify_one();
+		}
+	}
+
+	void execute(size_t n, size_t grain, bool nearest,
+	             void (*body)(void *, size_t, size_t, unsigned), void *ctx)
+	{
+		if (!n)
+			return;
+		if (in_task || workers.empty()) {
+			rounding_mode rnd(nearest ? FE_TONEAREST : FE_DOWNWARD);
+			body(ctx, 0, n, 0);
+			return;
+		}
+		std::lock_guard<std::mutex> serial(run_m);
+		unsigned k = size();
+		if (!grain)
+			grain = std::max<size_t>(n / (16 * k), 1);
+		for (unsigned p=0; p<k; p++) {
+			parts[p].b = n * p / k;
+			parts[p].e = n * (p + 1) / k;
+		}
+		job j { body, ctx, grain, nearest, { false }, {}, {} };
+		{
+			std::lock_guard<std::mutex> lock(m);
+			cur = &j;
+			active = workers.size();
+			gen++;
+		}
+		cv.notify_all();
+		{
+			rounding_mode rnd(nearest ? FE_TONEAREST : FE_DOWNWARD);
+			participate(j, 0);
+		}
+		std::unique_lock<std::mutex> lock(m);
+		done_cv.wait(lock, [this]{ return !active; });
+		cur = nullptr;
+		if (j.err)
+			std::rethrow_exception(j.err);
+	}
+
+	template <typename F> struct unwrap { using type = F; static constexpr bool nearest = false; };
+	template <typename F> struct unwrap<round_nearest<F>> { using type = F; static constexpr bool nearest = true; };
+
+	template <typename F> static F & fn(F &f) { return f; }
+	template <typename F> static F & fn(round_nearest<F> &f) { return f.f; }
+
+public:
+	/* n threads including the calling one, by default one per hardware thread */
+	explicit executor(unsigned n = 0)
+	{
+		if (!n)
+			n = std::max(std::thread::hardware_concurrency(), 1U);
+		parts.reset(new part[n]);
+		for (unsigned p=1; p<n; p++)
+			workers.emplace_back([this,p]{ loop(p); });
+	}
+
+	executor(const executor &) = delete;
+	executor & operator=(const executor &) = delete;
+
+	~executor()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m);
+			stop = true;
+		}
+		cv.notify_all();
+		for (std::thread &t : workers)
+			t.join();
+	}
+
+	unsigned size() const { return workers.size() + 1; }
+
+	/* f(i) for i in [0,n), concurrently */
+	template <typename F>
+	void parallel_for(size_t n, F &&f, size_t grain = 0)
+	{
+		using G = std::remove_reference_t<F>;
+		using U = typename unwrap<std::remove_cv_t<G>>::type;
+		U &g = fn(const_cast<std::remove_cv_t<G> &>(f));
+		execute(n, grain, unwrap<std::remove_cv_t<G>>::nearest,
+		        [](void *ctx, size_t b, size_t e, unsigned) {
+			U &g = *static_cast<U *>(ctx);
+			for (; b < e; b++)
+				g(b);
+		}, &g);
+	}
+
+	/* f(*it) for the elements of a random-access range, e.g. of ivals */
+	template <typename It, typename F>
+	std::enable_if_t<std::is_base_of_v<std::random_access_iterator_tag,
+	                 typename std::iterator_traits<It>::iterator_category>>
+	parallel_for(It first, It last, F &&f, size_t grain = 0)
+	{
+		if constexpr (unwrap<std::decay_t<F>>::nearest)
+			parallel_for(last - first, nearest([first,&g = f.f](size_t i){ g(first[i]); }), grain);
+		else
+			parallel_for(last - first, [first,&f](size_t i){ f(first[i]); }, grain);
+	}
+
+	/* combine(...combine(init, map(i0))..., map(ik)) over all i in [0,n)
+	 * in some order and grouping: combine must be associative and
+	 * commutative for the result not to depend on the scheduling. It is
+	 * called in the rounding mode of map. */
+	template <typename T, typename M, typename C>
+	T parallel_reduce(size_t n, T init, M &&map, C &&combine, size_t grain = 0)
+	{
+		using G = std::remove_cv_t<std::remove_reference_t<M>>;
+		using U = typename unwrap<G>::type;
+		constexpr bool rn = unwrap<G>::nearest;
+		struct alignas(64) partial { std::optional<T> v; };
+		std::vector<partial> acc(size());
+		struct ctx_t { U &map; C &combine; std::vector<partial> &acc; }
+			ctx { fn(const_cast<G &>(map)), combine, acc };
+		execute(n, grain, rn, [](void *c, size_t b, size_t e, unsigned p) {
+			ctx_t &x = *static_cast<ctx_t *>(c);
+			std::optional<T> &a = x.acc[p].v;
+			for (; b < e; b++)
+				if (a)
+					a = x.combine(std::move(*a), x.map(b));
+				else
+					a = x.map(b);
+		}, &ctx);
+		rounding_mode rnd(rn ? FE_TONEAREST : FE_DOWNWARD);
+		for (partial &a : acc)
+			if (a.v)
+				init = combine(std::move(init), std::move(*a.v));
+		return init;
+	}
+
+	template <typename It, typename T, typename M, typename C>
+	std::enable_if_t<std::is_base_of_v<std::random_access_iterator_tag,
+	                 typename std::iterator_traits<It>::iterator_category>,T>
+	parallel_reduce(It first, It last, T init, M &&map, C &&combine, size_t grain = 0)
+	{
+		if constexpr (unwrap<std::decay_t<M>>::nearest)
+			return parallel_reduce(last - first, std::move(init),
+			                       nearest([first,&g = map.f](size_t i){ return g(first[i]); }),
+			                       combine, grain);
+		else
+			return parallel_reduce(last - first, std::move(init),
+			                       [first,&map](size_t i){ return map(first[i]); },
+			                       combine, grain);
+	}
+};
+
+}
+
+#endif
@@ -11,10 +11,17 @@
 
 #include <cfenv>	/* fe[gs]etround() */
 #include <cmath>	/* INFINITY */
+#include <cstring>	/* memcpy */
+#include <cctype>	/* isdigit, tolower */
 #include <sstream>
 #include <cassert>
+#include <array>
+#include <vector>
+#include <charconv>	/* std::from_chars_result */
 #include <kay/numbers.hh>
 #include <kay/numbits.hh>
+#include <kay/dispatch.hh>
+#include <kay/dbl-profile.hh>
 
 namespace kay::dbl {
 
@@ -37,12 +44,19 @@ class rounding_mode {
 	const bool changed;
 
 public:
+#if (KAY_IVAL_PROFILE-0)
+	rounding_mode(int mode, profile::source_location loc = profile::source_location::current())
+#else
 	rounding_mode(int mode)
+#endif
 	: old(fegetround())
 	, changed(old != mode)
 	{
 		if (!changed)
 			return;
+#if (KAY_IVAL_PROFILE-0)
+		profile::record_switches(2, loc);
+#endif
 		if (int r = fesetround(mode)) {
 			std::stringstream ss;
 			ss << "fesetround(" << mode << ") failed with code "
@@ -110,6 +124,7 @@ enum ival_sgn : int32_t {
 };
 
 using kay::flt_prec;
+using kay::cmp;
 
 template <typename C, typename R>
 struct cnt_rad { C c; R r; };
@@ -226,66 +241,23 @@ public:
 		return { min(a.lo_pos, b.lo_pos), min(a.hi_neg, b.hi_neg) };
 	}
 
-	friend ival   operator- (const ival &a) { return { a.hi_neg, a.lo_pos }; }
+	friend constexpr ival operator- (const ival &a) { return { a.hi_neg, a.lo_pos }; }
 
 	friend void neg(ival &a) { using std::swap; swap(a.lo_pos, a.hi_neg); }
 
-	friend ival & operator+=(ival &a, const ival &b)
-	{ a.lo_pos += b.lo_pos; a.hi_neg += b.hi_neg; return a; }
-	friend ival   operator+ (ival  a, const ival &b) { a += b; return a; }
-
-	friend ival   operator-=(ival &a, const ival &b) { a += -b; return a; }
-	friend ival   operator- (ival  a, const ival &b) { a -= b; return a; }
+private:
+	/* the operations on two ivals, which the operators below call */
 
-	template <typename L, typename = op_compat_t<L,float,double>>
-	friend ival   operator+ (const ival &a, const L &b)
+	static ival add(ival a, const ival &b)
 	{
-		return { a.lo_pos + b, a.hi_neg - b };
+		a.lo_pos += b.lo_pos;
+		a.hi_neg += b.hi_neg;
+		return a;
 	}
 
-	template <typename L, typename = op_compat_t<L,float,double>>
-	friend ival   operator* (const L &a, const ival &b)
-	{
-		if (a >= 0)
-			return { a * b.lo_pos, a * b.hi_neg };
-		else
-			return { -a * b.hi_neg, -a * b.lo_pos };
-	}
-
-#if 0
-	/* x*y + z */
-	template <typename L, typename = op_compat_t<L,float,double>>
-	friend ival   fma(const L &x, const ival &y, const ival &z)
-	{
-		if (x >= 0)
-			return {
-				fma(x, y.lo_pos, z.lo_pos),
-				fma(x, y.hi_neg, z.hi_neg),
-			};
-		else
-			return {
-				fma(-x, y.hi_neg, z.lo_pos),
-				fma(-x, y.lo_pos, z.hi_neg),
-			};
-	}
-
-	template <typename L, typename = op_compat_t<L,float,double>>
-	friend ival   fma(const L &x, const ival &y, const L &z)
-	{
-		if (x >= 0)
-			return {
-				fma(x, y.lo_pos, z),
-				fma(x, y.hi_neg, z),
-			};
-		else
-			return {
-				fma(-x, y.hi_neg, z),
-				fma(-x, y.lo_pos, z),
-			};
-	}
-#endif
+	static ival sub(const ival &a, const ival &b) { return add(a, -b); }
 
-	friend ival   operator* (const ival &a, const ival &b)
+	static ival mul(const ival &a, const ival &b)
 	{
 		if (lo(a) >= 0 && lo(b) >= 0) {
 			/* both non-negative */
@@ -308,9 +280,8 @@ public:
 			};
 		}
 	}
-	friend ival & operator*=(ival &a, const ival &b) { a = a * b; return a; }
 
-	friend ival   operator/ (const ival &a, const ival &b)
+	static ival div(const ival &a, const ival &b)
 	{
 		if (b.lo_pos > 0) {
 			if (a.lo_pos > 0)
@@ -331,9 +302,8 @@ public:
 			return { -INFINITY, -INFINITY };
 		}
 	}
-	friend ival & operator/=(ival &a, const ival &b) { a = a / b; return a; }
 
-	friend ival square(const ival &i)
+	static ival sqr(const ival &i)
 	{
 		double lp = i.lo_pos, hn = i.hi_neg;
 		using std::min;
@@ -346,8 +316,101 @@ public:
 		kay_unreachable();
 	}
 
+#if (KAY_IVAL_PROFILE-0)
+	/* upper bound on wid(v) / mag(v), 0 for [0] */
+	static double relwid(const ival &v)
+	{
+		if (!isbounded(v))
+			return INFINITY;
+		double m = mag(v);
+		return m > 0 ? hi(wid_enc(v)) / m : 0;
+	}
+
+	static ival profiled(const char *op, const ival &r, const ival &a,
+	                     const ival &b, const profile::source_location &loc)
+	{
+		using std::max;
+		profile::record(op, max(relwid(a), relwid(b)), relwid(r), loc);
+		return r;
+	}
+
+# define KAY_IVAL_BINOP(op, fn)                                                \
+	friend ival   operator op (const ival &a, profile::at<ival> b)         \
+	{ return profiled(#op, fn(a, b.v), a, b.v, b.loc); }                   \
+	friend ival & operator op##= (ival &a, profile::at<ival> b)           \
+	{ return a = profiled(#op "=", fn(a, b.v), a, b.v, b.loc); }
+#else
+# define KAY_IVAL_BINOP(op, fn)                                                \
+	friend ival   operator op (const ival &a, const ival &b) { return fn(a, b); } \
+	friend ival & operator op##= (ival &a, const ival &b) { return a = fn(a, b); }
+#endif
+
+public:
+	KAY_IVAL_BINOP(+, add)
+	KAY_IVAL_BINOP(-, sub)
+	KAY_IVAL_BINOP(*, mul)
+	KAY_IVAL_BINOP(/, div)
+#undef KAY_IVAL_BINOP
+
+	template <typename L, typename = op_compat_t<L,float,double>>
+	friend ival   operator+ (const ival &a, const L &b)
+	{
+		return { a.lo_pos + b, a.hi_neg - b };
+	}
+
+	template <typename L, typename = op_compat_t<L,float,double>>
+	friend ival   operator* (const L &a, const ival &b)
+	{
+		if (a >= 0)
+			return { a * b.lo_pos, a * b.hi_neg };
+		else
+			return { -a * b.hi_neg, -a * b.lo_pos };
+	}
+
+#if 0
+	/* x*y + z */
+	template <typename L, typename = op_compat_t<L,float,double>>
+	friend ival   fma(const L &x, const ival &y, const ival &z)
+	{
+		if (x >= 0)
+			return {
+				fma(x, y.lo_pos, z.lo_pos),
+				fma(x, y.hi_neg, z.hi_neg),
+			};
+		else
+			return {
+				fma(-x, y.hi_neg, z.lo_pos),
+				fma(-x, y.lo_pos, z.hi_neg),
+			};
+	}
+
+	template <typename L, typename = op_compat_t<L,float,double>>
+	friend ival   fma(const L &x, const ival &y, const L &z)
+	{
+		if (x >= 0)
+			return {
+				fma(x, y.lo_pos, z),
+				fma(x, y.hi_neg, z),
+			};
+		else
+			return {
+				fma(-x, y.hi_neg, z),
+				fma(-x, y.lo_pos, z),
+			};
+	}
+#endif
+
+#if (KAY_IVAL_PROFILE-0)
+	friend ival square(profile::at<ival> i)
+	{
+		return profiled("square", sqr(i.v), i.v, i.v, i.loc);
+	}
+#else
+	friend ival square(const ival &i) { return sqr(i); }
+#endif
+
 	// TODO: use fma(3)
-	friend void fma(ival &r, const ival &a, const ival &b) { r += a * b; }
+	friend void fma(ival &r, const ival &a, const ival &b) { r = add(r, mul(a, b)); }
 
 	friend ival_pos cmp_detailed(const ival &a, const ival &b)
 	{
@@ -379,6 +442,16 @@ public:
 		return 0;
 	}
 
+	/* as above for the point a, without converting it */
+	friend int cmp(const Q &a, const ival &b)
+	{
+		if (cmp(a, lo(b)) < 0)
+			return -1;
+		if (cmp(a, hi(b)) > 0)
+			return +1;
+		return 0;
+	}
+
 	friend ival_sgn sgn(const ival &a)
 	{
 		if (lo(a) > 0)
@@ -413,6 +486,12 @@ public:
 		return lo(a) >= lo(b) && hi(a) <= hi(b);
 	}
 
+	/* a and b are the same set */
+	friend bool identical(const ival &a, const ival &b)
+	{
+		return lo(a) == lo(b) && hi(a) == hi(b);
+	}
+
 	friend std::ostream & operator<<(std::ostream &os, const ival &a)
 	{
 		if (isempty(a))
@@ -434,6 +513,547 @@ public:
 	}
 };
 
+/* the same operands are accepted with and without KAY_IVAL_PROFILE */
+static_assert(std::is_same_v<decltype(std::declval<const ival &>() + endpts{}), ival>);
+static_assert(std::is_same_v<decltype(std::declval<const ival &>() * cnt_rad<double,double>{}), ival>);
+static_assert(std::is_same_v<decltype(std::declval<ival &>() -= endpts{}), ival &>);
+static_assert(std::is_same_v<decltype(std::declval<ival &>() /= cnt_rad<double,double>{}), ival &>);
+static_assert(std::is_same_v<decltype(square(std::declval<const ival &>())), ival>);
+
+namespace detail {
+
+KAY_KERNEL void bulk_add(const ival *a, const ival *b, size_t n, ival *r)
+{
+	for (size_t i=0; i<n; i++)
+		r[i] = a[i] + b[i];
+}
+
+KAY_KERNEL void bulk_sub(const ival *a, const ival *b, size_t n, ival *r)
+{
+	for (size_t i=0; i<n; i++)
+		r[i] = a[i] - b[i];
+}
+
+KAY_KERNEL void bulk_mul(const ival *a, const ival *b, size_t n, ival *r)
+{
+	for (size_t i=0; i<n; i++)
+		r[i] = a[i] * b[i];
+}
+
+/* Independent partial sums, which vectorize: rounded downwards, the sums of
+ * the lower bounds and of the negated upper bounds enclose the exact sum in
+ * any order of summation. */
+KAY_KERNEL ival bulk_sum(const ival *a, size_t n)
+{
+	ival s[8];
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+		for (size_t j=0; j<8; j++)
+			s[j] += a[i+j];
+	for (; i < n; i++)
+		s[0] += a[i];
+	return ((s[0] + s[1]) + (s[2] + s[3])) + ((s[4] + s[5]) + (s[6] + s[7]));
+}
+
+KAY_MULTIVERSION(bulk_add, void, (const ival *a, const ival *b, size_t n, ival *r), (a, b, n, r))
+KAY_MULTIVERSION(bulk_sub, void, (const ival *a, const ival *b, size_t n, ival *r), (a, b, n, r))
+KAY_MULTIVERSION(bulk_mul, void, (const ival *a, const ival *b, size_t n, ival *r), (a, b, n, r))
+KAY_MULTIVERSION(bulk_sum, ival, (const ival *a, size_t n), (a, n))
+
+/* arrays shorter than this are processed inline */
+constexpr size_t bulk_dispatch_min = 64;
+
+}
+
+/* Elementwise r[i] = a[i] op b[i] for i in [0,n), where r may be a or b, and
+ * the sum of a[0,n). Like the scalar operations, these require FE_DOWNWARD.
+ * Arrays of at least 64 elements are processed by the variant for
+ * selected_isa(). */
+
+inline void add(const ival *a, const ival *b, size_t n, ival *r)
+{
+	if (n < detail::bulk_dispatch_min)
+		return detail::bulk_add(a, b, n, r);
+	static const auto f = detail::bulk_add_isa::select();
+	f(a, b, n, r);
+}
+
+inline void sub(const ival *a, const ival *b, size_t n, ival *r)
+{
+	if (n < detail::bulk_dispatch_min)
+		return detail::bulk_sub(a, b, n, r);
+	static const auto f = detail::bulk_sub_isa::select();
+	f(a, b, n, r);
+}
+
+inline void mul(const ival *a, const ival *b, size_t n, ival *r)
+{
+	if (n < detail::bulk_dispatch_min)
+		return detail::bulk_mul(a, b, n, r);
+	static const auto f = detail::bulk_mul_isa::select();
+	f(a, b, n, r);
+}
+
+inline ival sum(const ival *a, size_t n)
+{
+	if (n < detail::bulk_dispatch_min)
+		return detail::bulk_sum(a, n);
+	static const auto f = detail::bulk_sum_isa::select();
+	return f(a, n);
+}
+
+namespace detail {
+
+/* --------------------------------------------------------------------------
+ * decimal to double-interval conversion
+ * -------------------------------------------------------------------------- */
+
+using u128 = unsigned __int128;
+
+/* requires v != 0 */
+constexpr int clz128(u128 v)
+{
+	uint64_t h = v >> 64;
+	return h ? __builtin_clzll(h) : 64 + __builtin_clzll((uint64_t)v);
+}
+
+constexpr uint64_t pow5_u64(unsigned n)
+{
+	uint64_t r = 1;
+	while (n--)
+		r *= 5;
+	return r;
+}
+
+/* 5^q for q in [pow5_min,pow5_max] is approximated from below by m * 2^e with
+ * m normalized to [2^127,2^128). Each step of the construction loses less than
+ * 2^-127 relative precision, therefore 5^q < (m + 2^10) * 2^e holds. */
+struct pow5_approx { u128 m; int e; };
+
+constexpr int pow5_min = -362; /* 10^19 * 10^-363 < 2^-1074 */
+constexpr int pow5_max =  309; /* 10^309 > DBL_MAX */
+
+constexpr std::array<pow5_approx,pow5_max-pow5_min+1> make_pow5_table()
+{
+	std::array<pow5_approx,pow5_max-pow5_min+1> t {};
+	u128 m = (u128)1 << 127;
+	int e = -127;
+	t[-pow5_min] = { m, e };
+	for (int q=1; q<=pow5_max; q++) {
+		/* m*5 = h*2^64 + l with 2^65 < h < 2^67 */
+		u128 l = (u128)(uint64_t)m * 5;
+		u128 h = (m >> 64) * 5 + (l >> 64);
+		int z = clz128(h);
+		m = h << z | (uint64_t)l >> (64 - z);
+		e += 64 - z;
+		t[q-pow5_min] = { m, e };
+	}
+	m = (u128)1 << 127;
+	e = -127;
+	for (int q=-1; q>=pow5_min; q--) {
+		/* floor(m*2^z/5) */
+		u128 d = m / 5, r = m % 5;
+		int z = clz128(d);
+		m = (d << z) + (r << z) / 5;
+		e -= z;
+		t[q-pow5_min] = { m, e };
+	}
+	return t;
+}
+
+inline constexpr auto pow5_table = make_pow5_table();
+
+/* a parsed decimal literal of absolute value (w + eps) * 10^q, 0 <= eps < 1 */
+struct decimal {
+	uint64_t w = 0;         /* the first up to 19 significant digits */
+	int64_t q = 0;
+	bool trunc = false;     /* eps > 0: non-zero digits did not fit into w */
+	bool neg = false;
+	int64_t exp = 0;        /* explicit exponent */
+	const char *mant;       /* mantissa digits, possibly including '.' */
+	const char *mant_end;
+};
+
+/* parses [+-]?([0-9]+\.?[0-9]*|\.[0-9]+)([eE][+-]?[0-9]+)?, returns the end
+ * or nullptr in case no digit was found */
+inline const char * parse_decimal(const char *p, const char *end, decimal &d)
+{
+	if (p < end && (*p == '+' || *p == '-'))
+		d.neg = *p++ == '-';
+	d.mant = p;
+	unsigned n = 0;
+	bool any = false, dot = false;
+	for (; p < end; p++) {
+		if (*p == '.' && !dot) {
+			dot = true;
+			continue;
+		}
+		if (!isdigit((unsigned char)*p))
+			break;
+		any = true;
+		unsigned dg = *p - '0';
+		if (n < 19) {
+			if (n || dg) {
+				d.w = 10 * d.w + dg;
+				n++;
+			}
+			if (dot)
+				d.q--;
+		} else {
+			d.trunc |= dg != 0;
+			if (!dot)
+				d.q++;
+		}
+	}
+	if (!any)
+		return nullptr;
+	d.mant_end = p;
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		const char *s = p + 1;
+		bool eneg = false;
+		if (s < end && (*s == '+' || *s == '-'))
+			eneg = *s++ == '-';
+		if (s < end && isdigit((unsigned char)*s)) {
+			int64_t e = 0;
+			for (; s < end && isdigit((unsigned char)*s); s++)
+				if (e < 1000000000)
+					e = 10 * e + (*s - '0');
+			d.exp = eneg ? -e : e;
+			p = s;
+		}
+	}
+	d.q += d.exp;
+	return p;
+}
+
+/* minimal natural numbers for the exact comparisons of the slow path */
+class bignat {
+
+	std::vector<uint32_t> l; /* little-endian, no leading zero limbs */
+
+public:
+	explicit bignat(uint64_t v = 0)
+	{
+		for (; v; v >>= 32)
+			l.push_back(v);
+	}
+
+	void mul_add(uint32_t m, uint32_t a)
+	{
+		uint64_t c = a;
+		for (uint32_t &x : l) {
+			c += (uint64_t)x * m;
+			x = c;
+			c >>= 32;
+		}
+		if (c)
+			l.push_back(c);
+	}
+
+	void mul_pow5(uint64_t n)
+	{
+		for (; n >= 13; n -= 13)
+			mul_add(pow5_u64(13), 0);
+		mul_add(pow5_u64(n), 0);
+	}
+
+	void shl(uint64_t n)
+	{
+		if (l.empty())
+			return;
+		unsigned b = n % 32;
+		if (b) {
+			uint32_t c = 0;
+			for (uint32_t &x : l) {
+				uint32_t y = x >> (32 - b);
+				x = x << b | c;
+				c = y;
+			}
+			if (c)
+				l.push_back(c);
+		}
+		l.insert(l.begin(), n / 32, 0);
+	}
+
+	friend int cmp(const bignat &a, const bignat &b)
+	{
+		if (a.l.size() != b.l.size())
+			return a.l.size() < b.l.size() ? -1 : +1;
+		for (size_t i=a.l.size(); i--;)
+			if (a.l[i] != b.l[i])
+				return a.l[i] < b.l[i] ? -1 : +1;
+		return 0;
+	}
+};
+
+/* sign of |d| - f*2^scale, computed exactly */
+inline int cmp_exact(const decimal &d, uint64_t f, int scale)
+{
+	bignat a, b(f);
+	int64_t q = d.exp;
+	uint32_t chunk = 0;
+	unsigned k = 0;
+	bool frac = false;
+	for (const char *p = d.mant; p < d.mant_end; p++) {
+		if (*p == '.') {
+			frac = true;
+			continue;
+		}
+		chunk = 10 * chunk + (*p - '0');
+		q -= frac;
+		if (++k == 9) {
+			a.mul_add(1000000000, chunk);
+			chunk = k = 0;
+		}
+	}
+	uint32_t p10 = 1;
+	while (k--)
+		p10 *= 10;
+	a.mul_add(p10, chunk);
+	if (q >= 0)
+		a.mul_pow5(q);
+	else
+		b.mul_pow5(-q);
+	if (q > scale)
+		a.shl(q - scale);
+	else
+		b.shl(scale - q);
+	return cmp(a, b);
+}
+
+/* f*2^scale rounded up, exact for f <= 2^53 unless overflowing */
+inline double make_dbl(uint64_t f, int scale)
+{
+	if (!f)
+		return 0;
+	if (scale + 64 - __builtin_clzll(f) > DBL_MAX_EXP)
+		return INFINITY;
+	return std::ldexp((double)f, scale);
+}
+
+/* [f,f+1]*2^scale for f*2^scale < x < (f+1)*2^scale */
+inline endpts ulp_enc(uint64_t f, int scale)
+{
+	double l = make_dbl(f, scale);
+	return { std::isinf(l) ? DBL_MAX : l, make_dbl(f+1, scale) };
+}
+
+inline endpts point_enc(uint64_t f, int scale)
+{
+	double v = make_dbl(f, scale);
+	return { std::isinf(v) ? DBL_MAX : v, v };
+}
+
+/* Given 0 < a*2^e <= x <= b*2^e, computes f and scale such that f*2^scale is
+ * a*2^e truncated to double precision. Returns true if this determines the
+ * tightest enclosure r of x, otherwise the caller needs to resolve. */
+inline bool bounds_enc(u128 a, u128 b, int e, bool exact,
+                       endpts &r, uint64_t &f, int &scale)
+{
+	int ex = 127 - clz128(a) + e;
+	scale = std::max(ex - (DBL_MANT_DIG - 1), DBL_MIN_EXP - DBL_MANT_DIG);
+	int shift = scale - e;
+	if (shift <= 0) {
+		/* only the exact cases have less than 54 bits */
+		assert(exact);
+		f = (uint64_t)a << -shift;
+		r = point_enc(f, scale);
+		return true;
+	}
+	u128 ra = shift < 128 ? a & (((u128)1 << shift) - 1) : a;
+	f = shift < 128 ? (uint64_t)(a >> shift) : 0;
+	uint64_t fb = shift < 128 ? (uint64_t)(b >> shift) : 0;
+	if (f != fb || (!ra && !exact))
+		return false;
+	r = ra ? ulp_enc(f, scale) : point_enc(f, scale);
+	return true;
+}
+
+/* tightest enclosure of |d| */
+inline endpts decimal_enc(const decimal &d)
+{
+	if (!d.w)
+		return { 0, 0 };
+	if (d.q > pow5_max)
+		return { DBL_MAX, INFINITY };
+	if (d.q < pow5_min)
+		return { 0, std::numeric_limits<double>::denorm_min() };
+
+	int s = __builtin_clzll(d.w);
+	uint64_t w = d.w << s;
+	u128 a, b;
+	int e;
+	bool exact = !d.trunc && -27 <= d.q && d.q <= 27;
+	if (exact) {
+		/* 5^27 < 2^63: exact integer arithmetic */
+		if (d.q >= 0) {
+			a = (u128)w * pow5_u64(d.q);
+			e = d.q - s;
+		} else {
+			u128 p = pow5_u64(-d.q), n = (u128)w << 64;
+			a = n / p;
+			e = d.q - s - 64;
+			if (n % p) {
+				/* strictly between a and a+1, a >= 2^64 */
+				a = 2 * a + 1;
+				e--;
+			}
+		}
+		b = a;
+	} else {
+		/* Eisel-Lemire: multiply by the truncated 128-bit power of five
+		 * and bound the error of the approximation */
+		const pow5_approx &p = pow5_table[d.q - pow5_min];
+		u128 l = (u128)w * (uint64_t)p.m;
+		a = (u128)w * (uint64_t)(p.m >> 64) + (l >> 64);
+		e = p.e + d.q - s + 64;
+		/* d.trunc implies w >= 10^18, i.e., s <= 4 */
+		uint64_t t = (uint64_t)d.trunc << s;
+		b = a + 2 + ((u128)1 << 10) + t * ((p.m >> 64) + 1);
+		if (b < a)
+			b = ~(u128)0;
+	}
+
+	endpts r;
+	uint64_t f;
+	int scale;
+	if (bounds_enc(a, b, e, exact, r, f, scale))
+		return r;
+
+	/* slow path: x is within 1 ulp of the boundary (f+1)*2^scale */
+	int c = cmp_exact(d, f, scale);
+	assert(c >= 0);
+	if (!c)
+		return point_enc(f, scale);
+	if (++f == (uint64_t)1 << DBL_MANT_DIG) {
+		f >>= 1;
+		scale++;
+	}
+	c = cmp_exact(d, f, scale);
+	if (c < 0)
+		return ulp_enc(f-1, scale);
+	if (!c)
+		return point_enc(f, scale);
+	return ulp_enc(f, scale);
+}
+
+inline bool is_blank(char c) { return c == ' ' || c == '\t'; }
+
+inline const char * skip_blanks(const char *p, const char *end)
+{
+	while (p < end && is_blank(*p))
+		p++;
+	return p;
+}
+
+/* case-insensitive match of a prefix of [p,end) to s */
+inline const char * match_ci(const char *p, const char *end, const char *s)
+{
+	for (; *s; s++, p++)
+		if (p == end || tolower((unsigned char)*p) != *s)
+			return nullptr;
+	return p;
+}
+
+/* parses an endpoint: a decimal or [+-]?(inf|infty|infinity) */
+inline const char * parse_endpt(const char *p, const char *end, endpts &r)
+{
+	const char *s = p;
+	bool neg = false;
+	if (s < end && (*s == '+' || *s == '-'))
+		neg = *s++ == '-';
+	if (const char *t = match_ci(s, end, "inf")) {
+		if (const char *u = match_ci(t, end, "inity"))
+			t = u;
+		else if (const char *u = match_ci(t, end, "ty"))
+			t = u;
+		r.l = r.u = neg ? -INFINITY : INFINITY;
+		return t;
+	}
+	decimal d;
+	const char *t = parse_decimal(p, end, d);
+	if (!t)
+		return nullptr;
+	r = decimal_enc(d);
+	if (d.neg)
+		r = { -r.u, -r.l };
+	return t;
+}
+
+} /* namespace detail */
+
+/* Parses a decimal number "-0.1e-3" or an interval "[a,b]" or "[a]" directly
+ * into the tightest enclosing ival. Brackets may be replaced by parentheses
+ * and endpoints of intervals may be infinite, which allows to read the
+ * output of operator<<. Does not depend on the rounding mode and does not
+ * allocate unless a decimal is extremely close to a double. */
+inline std::from_chars_result
+from_chars(const char *first, const char *last, ival &v)
+{
+	instrument::count(instrument::parse);
+	using namespace detail;
+	endpts r;
+	const char *p = first;
+	if (p < last && (*p == '[' || *p == '(')) {
+		endpts l, u;
+		p = parse_endpt(skip_blanks(p + 1, last), last, l);
+		if (!p)
+			return { first, std::errc::invalid_argument };
+		p = skip_blanks(p, last);
+		if (p < last && *p == ',') {
+			p = parse_endpt(skip_blanks(p + 1, last), last, u);
+			if (!p)
+				return { first, std::errc::invalid_argument };
+			p = skip_blanks(p, last);
+		} else {
+			if (std::isinf(l.l) && l.l == l.u)
+				return { first, std::errc::invalid_argument };
+			u = l;
+		}
+		if (p == last || (*p != ']' && *p != ')'))
+			return { first, std::errc::invalid_argument };
+		r = { l.l, u.u };
+		if (!(r.l <= r.u) || r.l == INFINITY || r.u == -INFINITY)
+			return { first, std::errc::invalid_argument };
+		p++;
+	} else {
+		decimal d;
+		p = parse_decimal(p, last, d);
+		if (!p)
+			return { first, std::errc::invalid_argument };
+		r = decimal_enc(d);
+		if (d.neg)
+			r = { -r.u, -r.l };
+	}
+	v = r;
+	return { p, std::errc {} };
+}
+
+}
+
+namespace kay {
+
+/* consistent with identical(): both zeros hash equally */
+template <typename H> struct hash<dbl::ival,H> {
+
+	/* nearby doubles differ in the low bits of the mantissa and at the top,
+	 * the latter of which the combination in H does not propagate down */
+	static uint64_t bits_of(double d) noexcept
+	{
+		uint64_t r = 0;
+		if (d != 0)
+			memcpy(&r, &d, sizeof(r));
+		r ^= r >> 31;
+		r *= 0xbf58476d1ce4e5b9;
+		return r ^ r >> 32;
+	}
+
+	size_t operator()(const dbl::ival &v) const noexcept
+	{
+		return (H() ^ H(bits_of(lo(v))) ^ H(bits_of(hi(v)))).v;
+	}
+};
+
 }
 
 #endif
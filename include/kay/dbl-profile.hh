@@ -0,0 +1,258 @@
+/*
+ * dbl-profile.hh
+ *
+ * Copyright 2018-2022 Franz Brauße <fb@paxle.org>
+ *
+ * See the LICENSE file for terms of distribution.
+ */
+
+#ifndef KAY_DBL_PROFILE_HH
+#define KAY_DBL_PROFILE_HH
+
+#include <cstdint>
+#include <cmath>	/* std::log2 */
+#include <cfloat>	/* DBL_EPSILON */
+#include <mutex>
+#include <map>
+#include <vector>
+#include <string_view>
+#include <type_traits>	/* std::enable_if_t, std::is_convertible_v */
+#include <algorithm>	/* std::sort */
+#include <ostream>
+
+#include <kay/per-thread.hh>
+
+#if __has_include(<source_location>) && __cplusplus > 201703L
+# include <source_location>
+#endif
+
+/* Profiler of the width growth caused by the operations on dbl::ival,
+ * enabled by compiling with KAY_IVAL_PROFILE=1, which then has to hold for
+ * all translation units. Each binary operation +, -, *, / (and the compound
+ * assignments) of two ivals and square() records at its call site by how many
+ * bits the relative width wid/mag of the result exceeds the larger one of the
+ * operands; points count as having a relative width of DBL_EPSILON/2. The
+ * operations with a double operand are not recorded. Each rounding_mode
+ * changing the mode counts two switches at the site constructing it.
+ *
+ * Sites are distinguished by file, line, column (with C++20) and operation;
+ * the operations record into tables per thread, the counts of exited threads
+ * are kept. */
+
+namespace kay::dbl::profile {
+
+#if __cpp_lib_source_location
+using std::source_location;
+#else
+/* the subset of std::source_location provided by the compiler builtins of
+ * GCC and Clang */
+class source_location {
+	const char *file = "";
+	const char *func = "";
+	unsigned ln = 0;
+public:
+	static constexpr source_location
+	current(const char *file = __builtin_FILE(),
+	        const char *func = __builtin_FUNCTION(),
+	        unsigned ln = __builtin_LINE()) noexcept
+	{
+		source_location r;
+		r.file = file;
+		r.func = func;
+		r.ln = ln;
+		return r;
+	}
+	constexpr const char * file_name() const noexcept { return file; }
+	constexpr const char * function_name() const noexcept { return func; }
+	constexpr unsigned line() const noexcept { return ln; }
+	constexpr unsigned column() const noexcept { return 0; }
+};
+#endif
+
+/* Operand of a profiled operation: converting to it from a T records the
+ * location of the expression converting, i.e., of the operation. It accepts
+ * any type implicitly convertible to T in a single conversion, so that the
+ * same expressions compile as with a parameter of type const T &. */
+template <typename T>
+struct at {
+	T v;
+	source_location loc;
+
+	template <typename U, std::enable_if_t<std::is_convertible_v<const U &,T>,int> = 0>
+	at(const U &v, source_location loc = source_location::current())
+	: v(v), loc(loc) {}
+};
+
+struct site {
+	std::string_view file, op;
+	unsigned line, column;
+	const char *function;
+	uint64_t count = 0;      /* operations or rounding-mode switches */
+	uint64_t unbounded = 0;  /* operations with an unbounded result */
+	double bits = 0;         /* total width growth in bits */
+	double max_bits = 0;
+
+	double mean_bits() const { return count ? bits / count : 0; }
+};
+
+namespace detail {
+
+struct key {
+	std::string_view file, op;
+	unsigned line, column;
+
+	friend bool operator<(const key &a, const key &b)
+	{
+		if (a.line != b.line)
+			return a.line < b.line;
+		if (a.column != b.column)
+			return a.column < b.column;
+		if (a.op != b.op)
+			return a.op < b.op;
+		return a.file < b.file;
+	}
+};
+
+using sites_map = std::map<key,site>;
+
+inline void merge(sites_map &into, const sites_map &from)
+{
+	for (const auto &[k,s] : from) {
+		auto [it,ins] = into.try_emplace(k, s);
+		if (ins)
+			continue;
+		site &t = it->second;
+		t.count += s.count;
+		t.unbounded += s.unbounded;
+		t.bits += s.bits;
+		t.max_bits = std::max(t.max_bits, s.max_bits);
+	}
+}
+
+struct table {
+	std::mutex m;
+	sites_map sites;
+
+	void retire(sites_map &exited) const { merge(exited, sites); }
+};
+
+using threads = kay::detail::per_thread<table,sites_map>;
+
+inline site & at_site(table &t, const char *op, const source_location &loc)
+{
+	key k { loc.file_name(), op, unsigned(loc.line()), unsigned(loc.column()) };
+	auto [it,ins] = t.sites.try_emplace(k);
+	if (ins) {
+		site &s = it->second;
+		s.file = k.file;
+		s.op = k.op;
+		s.line = k.line;
+		s.column = k.column;
+		s.function = loc.function_name();
+	}
+	return it->second;
+}
+
+}
+
+/* Records the operation op at loc which computed a result of relative width
+ * out from operands of relative width at most in. */
+inline void record(const char *op, double in, double out, const source_location &loc)
+{
+	detail::table &t = detail::threads::local();
+	std::lock_guard<std::mutex> lock(t.m);
+	site &s = detail::at_site(t, op, loc);
+	s.count++;
+	if (std::isinf(out)) {
+		s.unbounded++;
+		return;
+	}
+	double b = std::log2(out / std::max(in, DBL_EPSILON / 2));
+	if (b > 0) {
+		s.bits += b;
+		s.max_bits = std::max(s.max_bits, b);
+	}
+}
+
+inline void record_switches(unsigned n, const source_location &loc)
+{
+	detail::table &t = detail::threads::local();
+	std::lock_guard<std::mutex> lock(t.m);
+	detail::at_site(t, "rounding_mode", loc).count += n;
+}
+
+/* All sites over all threads, those of operations ranked by their total width
+ * growth, followed by those of rounding-mode switches ranked by count. */
+inline std::vector<site> sites()
+{
+	detail::sites_map all;
+	detail::threads::visit([&](const detail::sites_map &e){ all = e; },
+	                       [&](unsigned, detail::table &t){
+		std::lock_guard<std::mutex> lock(t.m);
+		detail::merge(all, t.sites);
+	});
+	std::vector<site> v;
+	v.reserve(all.size());
+	for (const auto &[k,s] : all)
+		v.push_back(s);
+	auto is_switch = [](const site &s){ return s.op == "rounding_mode"; };
+	std::sort(v.begin(), v.end(), [&](const site &a, const site &b){
+		if (is_switch(a) != is_switch(b))
+			return is_switch(b);
+		if (a.bits != b.bits)
+			return a.bits > b.bits;
+		if (a.unbounded != b.unbounded)
+			return a.unbounded > b.unbounded;
+		return a.count > b.count;
+	});
+	return v;
+}
+
+/* Discards the sites recorded so far. Operations recorded concurrently by
+ * other threads may be lost or kept. */
+inline void reset()
+{
+	detail::threads::visit([](detail::sites_map &e){ e.clear(); },
+	                       [](unsigned, detail::table &t){
+		std::lock_guard<std::mutex> lock(t.m);
+		t.sites.clear();
+	});
+}
+
+/* The ranked sites(), at most max_rows of each kind. */
+inline void report(std::ostream &os, size_t max_rows = 20)
+{
+#if !(KAY_IVAL_PROFILE-0)
+	os << "kay: ival profiling disabled, compile with KAY_IVAL_PROFILE=1\n";
+#endif
+	std::vector<site> v = sites();
+	auto loc = [&os](const site &s) -> std::ostream & {
+		os << s.file << ":" << s.line;
+		if (s.column)
+			os << ":" << s.column;
+		return os << " (" << s.function << ")";
+	};
+	size_t rows = 0;
+	os << "bits\tcount\tmean\tmax\tunbounded\top\tsite\n";
+	for (const site &s : v) {
+		if (s.op == "rounding_mode" || rows++ == max_rows)
+			break;
+		os << s.bits << "\t" << s.count << "\t" << s.mean_bits() << "\t"
+		   << s.max_bits << "\t" << s.unbounded << "\t" << s.op << "\t";
+		loc(s) << "\n";
+	}
+	rows = 0;
+	os << "switches\tsite\n";
+	for (const site &s : v) {
+		if (s.op != "rounding_mode")
+			continue;
+		if (rows++ == max_rows)
+			break;
+		os << s.count << "\t";
+		loc(s) << "\n";
+	}
+}
+
+}
+
+#endif
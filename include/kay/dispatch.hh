@@ -0,0 +1,130 @@
+/*
+ * dispatch.hh
+ *
+ * Copyright 2018-2022 Franz Brauße <fb@paxle.org>
+ *
+ * See the LICENSE file for terms of distribution.
+ */
+
+#ifndef KAY_DISPATCH_HH
+#define KAY_DISPATCH_HH
+
+#include <cstdlib>	/* getenv */
+#include <cstring>	/* strcmp */
+#include <initializer_list>
+
+namespace kay {
+
+/* Instruction set levels the bulk kernels are compiled for in addition to the
+ * one of the translation unit. Each level includes the ones before. */
+enum class isa {
+	generic, /* whatever the compiler flags allow */
+	sse4_2,  /* + SSE4.2, POPCNT */
+	avx2,    /* + AVX2, FMA, BMI1/2, LZCNT */
+	avx512,  /* + AVX-512 F, VL, BW, DQ, CD */
+};
+
+inline const char * isa_name(isa i)
+{
+	switch (i) {
+	case isa::generic: return "generic";
+	case isa::sse4_2: return "sse4.2";
+	case isa::avx2: return "avx2";
+	case isa::avx512: return "avx512";
+	}
+	return "?";
+}
+
+/* the highest level supported by the CPU */
+inline isa detected_isa()
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+	__builtin_cpu_init();
+	/* every CPU with AVX2 also has LZCNT, which GCC does not test for */
+	bool avx2 = __builtin_cpu_supports("avx2") &&
+	            __builtin_cpu_supports("fma") &&
+	            __builtin_cpu_supports("bmi") &&
+	            __builtin_cpu_supports("bmi2");
+	if (avx2 && __builtin_cpu_supports("avx512f") &&
+	    __builtin_cpu_supports("avx512vl") &&
+	    __builtin_cpu_supports("avx512bw") &&
+	    __builtin_cpu_supports("avx512dq") &&
+	    __builtin_cpu_supports("avx512cd"))
+		return isa::avx512;
+	if (avx2)
+		return isa::avx2;
+	if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt"))
+		return isa::sse4_2;
+#endif
+	return isa::generic;
+}
+
+/* The level the dispatched kernels run at: detected_isa(), lowered to the
+ * one named by the environment variable KAY_ISA if that is set to one of the
+ * isa_name()s, e.g. for comparing the variants. Determined on the first call,
+ * which the first use of a dispatched kernel makes. */
+inline isa selected_isa()
+{
+	static const isa sel = []{
+		isa i = detected_isa();
+		if (const char *e = getenv("KAY_ISA"))
+			for (isa j : { isa::generic, isa::sse4_2, isa::avx2 })
+				if (!strcmp(e, isa_name(j)) && j < i)
+					i = j;
+		return i;
+	}();
+	return sel;
+}
+
+namespace dispatch_detail {
+
+template <typename F>
+F pick(F generic, F sse4_2, F avx2, F avx512)
+{
+	switch (selected_isa()) {
+	case isa::avx512: return avx512;
+	case isa::avx2: return avx2;
+	case isa::sse4_2: return sse4_2;
+	case isa::generic: break;
+	}
+	return generic;
+}
+
+}
+
+}
+
+/* KAY_MULTIVERSION(kernel, ret, params, args) defines the namespace
+ * kernel_isa containing copies of the function 'kernel', one per level in
+ * enum kay::isa, and select() returning the pointer to the one for
+ * selected_isa(). 'kernel' should be declared KAY_KERNEL: being inlined into
+ * the copies, its loops are vectorized with the instructions of each level.
+ * 'params' is the parenthesized parameter list, 'args' the parenthesized
+ * names of the parameters. On targets other than x86-64 all copies are
+ * the generic one. */
+#define KAY_KERNEL	[[gnu::always_inline]] inline
+
+#if defined(__x86_64__) && defined(__GNUC__)
+# define KAY_TARGET_SSE4_2	[[gnu::target("sse4.2,popcnt")]]
+# define KAY_TARGET_AVX2	[[gnu::target("avx2,fma,bmi,bmi2,lzcnt,popcnt")]]
+# define KAY_TARGET_AVX512	[[gnu::target("avx512f,avx512vl,avx512bw,avx512dq,avx512cd,avx2,fma,bmi,bmi2,lzcnt,popcnt")]]
+#else
+# define KAY_TARGET_SSE4_2
+# define KAY_TARGET_AVX2
+# define KAY_TARGET_AVX512
+#endif
+
+#define KAY_MULTIVERSION(kernel, ret, params, args)                            \
+	namespace kernel##_isa {                                               \
+	inline ret generic params { return kernel args; }                      \
+	KAY_TARGET_SSE4_2 inline ret sse4_2 params { return kernel args; }     \
+	KAY_TARGET_AVX2 inline ret avx2 params { return kernel args; }         \
+	KAY_TARGET_AVX512 inline ret avx512 params { return kernel args; }     \
+	inline ret (*select()) params                                          \
+	{                                                                      \
+		return ::kay::dispatch_detail::pick<ret (*) params>(           \
+			generic, sse4_2, avx2, avx512);                        \
+	}                                                                      \
+	}
+
+#endif
@@ -0,0 +1,191 @@
+/*
+ * fixed.hh
+ *
+ * Copyright 2018-2022 Franz Brauße <fb@paxle.org>
+ *
+ * See the LICENSE file for terms of distribution.
+ */
+
+#ifndef KAY_FIXED_HH
+#define KAY_FIXED_HH
+
+#include <ostream>
+#include <stdexcept>	/* std::overflow_error */
+
+#include <kay/numbers.hh>
+#include <kay/compiletime.hh>
+
+namespace kay::fixed {
+
+/* Integers v with |v| < 2^Bits in sign-magnitude representation with inline
+ * limbs. They never allocate; results exceeding the bound throw
+ * std::overflow_error. The arithmetic is that of compiletime::nat and
+ * therefore usable in constant expressions. Division truncates like Z. */
+template <size_t Bits>
+class Z {
+
+	static_assert(Bits > 0);
+
+	template <size_t> friend class Z;
+
+public:
+	static constexpr size_t limbs = (Bits + 63) / 64;
+	using nat = compiletime::nat<limbs>;
+
+private:
+	nat m;
+	bool negative = false;
+
+	constexpr Z & check()
+	{
+		if (bits(m) > Bits)
+			throw std::overflow_error("kay::fixed::Z: value exceeds bound");
+		if (!m)
+			negative = false;
+		return *this;
+	}
+
+public:
+	constexpr Z() = default;
+
+	constexpr Z(int64_t v)
+	: m(v < 0 ? -(uint64_t)v : v), negative(v < 0)
+	{ check(); }
+
+	explicit constexpr Z(const nat &magnitude, bool neg = false)
+	: m(magnitude), negative(neg)
+	{ check(); }
+
+	template <size_t B>
+	explicit constexpr Z(const Z<B> &v)
+	: m(v.m), negative(v.negative)
+	{ check(); }
+
+	constexpr const nat & magnitude() const { return m; }
+
+	explicit constexpr operator bool() const { return (bool)m; }
+
+	explicit operator kay::Z() const
+	{
+		static_assert(GMP_LIMB_BITS == 64 && GMP_NAIL_BITS == 0,
+		              "only 64-bit limbs are supported");
+		mp_limb_t d[limbs];
+		for (size_t i=0; i<limbs; i++)
+			d[i] = m[i];
+		mpz_t t;
+		kay::Z r(mpz_roinit_n(t, d, m.size()));
+		return negative ? -r : r;
+	}
+
+	friend constexpr int sgn(const Z &a) { return !a.m ? 0 : a.negative ? -1 : 1; }
+	friend constexpr Z abs(Z a) { a.negative = false; return a; }
+	friend constexpr size_t bits(const Z &a) { return bits(a.m); }
+
+	friend constexpr int cmp(const Z &a, const Z &b)
+	{
+		if (a.negative != b.negative)
+			return a.negative ? -1 : 1;
+		int c = cmp(a.m, b.m);
+		return a.negative ? -c : c;
+	}
+
+	friend constexpr bool operator==(const Z &a, const Z &b) { return cmp(a, b) == 0; }
+	friend constexpr bool operator!=(const Z &a, const Z &b) { return cmp(a, b) != 0; }
+	friend constexpr bool operator<=(const Z &a, const Z &b) { return cmp(a, b) <= 0; }
+	friend constexpr bool operator< (const Z &a, const Z &b) { return cmp(a, b) <  0; }
+	friend constexpr bool operator>=(const Z &a, const Z &b) { return cmp(a, b) >= 0; }
+	friend constexpr bool operator> (const Z &a, const Z &b) { return cmp(a, b) >  0; }
+
+	friend constexpr Z operator+(Z a) { return a; }
+	friend constexpr Z operator-(Z a) { a.negative = !a.negative; return a.check(); }
+
+	friend constexpr Z & operator+=(Z &a, const Z &b)
+	{
+		if (a.negative == b.negative)
+			a.m += b.m;
+		else if (a.m >= b.m)
+			a.m -= b.m;
+		else {
+			a.m = b.m - a.m;
+			a.negative = b.negative;
+		}
+		return a.check();
+	}
+	friend constexpr Z   operator+ (Z  a, const Z &b) { a += b; return a; }
+
+	friend constexpr Z & operator-=(Z &a, const Z &b) { return a += -b; }
+	friend constexpr Z   operator- (Z  a, const Z &b) { a -= b; return a; }
+
+	/* r = a*b, returns whether the product exceeds the bound, in which case
+	 * r is unchanged */
+	friend constexpr bool mul_overflow(const Z &a, const Z &b, Z &r)
+	{
+		nat m;
+		if (mul_overflow(a.m, b.m, m) || bits(m) > Bits)
+			return true;
+		r.m = m;
+		r.negative = m && a.negative != b.negative;
+		return false;
+	}
+
+	friend constexpr Z & operator*=(Z &a, const Z &b)
+	{
+		if (mul_overflow(a, b, a))
+			throw std::overflow_error("kay::fixed::Z: value exceeds bound");
+		return a;
+	}
+	friend constexpr Z   operator* (Z  a, const Z &b) { a *= b; return a; }
+
+	struct divmod_result;
+
+	/* truncating: a = q*b + r with |r| < |b| and sgn(r) in {0, sgn(a)};
+	 * throws std::domain_error if b is zero */
+	friend constexpr divmod_result divmod(const Z &a, const Z &b)
+	{
+		auto [q, r] = divmod(a.m, b.m);
+		return { Z(q, a.negative != b.negative), Z(r, a.negative) };
+	}
+
+	friend constexpr Z & operator/=(Z &a, const Z &b) { a = divmod(a, b).q; return a; }
+	friend constexpr Z   operator/ (Z  a, const Z &b) { a /= b; return a; }
+
+	friend constexpr Z & operator%=(Z &a, const Z &b) { a = divmod(a, b).r; return a; }
+	friend constexpr Z   operator% (Z  a, const Z &b) { a %= b; return a; }
+
+	friend std::ostream & operator<<(std::ostream &os, const Z &a)
+	{
+		return os << static_cast<kay::Z>(a);
+	}
+};
+
+template <size_t Bits>
+struct Z<Bits>::divmod_result { Z q, r; };
+
+/* product with sufficient bound */
+template <size_t B1, size_t B2>
+constexpr Z<B1+B2> mul_full(const Z<B1> &a, const Z<B2> &b)
+{
+	return Z<B1+B2>(a) * Z<B1+B2>(b);
+}
+
+namespace detail {
+template <size_t Bits>
+constexpr bool mul_overflows(const Z<Bits> &a, const Z<Bits> &b)
+{
+	Z<Bits> r;
+	return mul_overflow(a, b, r);
+}
+
+template <size_t Bits>
+constexpr Z<Bits> pow2(size_t e) { return Z<Bits>(typename Z<Bits>::nat(1) << e); }
+}
+
+static_assert( detail::mul_overflows(detail::pow2<256>(192), detail::pow2<256>(128)));
+static_assert( detail::mul_overflows(detail::pow2<192>(128), detail::pow2<192>(128)));
+static_assert( detail::mul_overflows(detail::pow2<200>(100), -detail::pow2<200>(100)));
+static_assert(!detail::mul_overflows(detail::pow2<200>(100), -detail::pow2<200>(99)));
+static_assert(detail::pow2<256>(128) * -detail::pow2<256>(127) == -detail::pow2<256>(255));
+
+}
+
+#endif
@@ -0,0 +1,770 @@
+/*
+ * flat-hash.hh
+ *
+ * Copyright 2018-2022 Franz Brauße <fb@paxle.org>
+ *
+ * See the LICENSE file for terms of distribution.
+ */
+
+#ifndef KAY_FLAT_HASH_HH
+#define KAY_FLAT_HASH_HH
+
+#include <cstring>	/* memcpy */
+#include <memory>	/* std::allocator */
+#include <functional>	/* std::equal_to */
+#include <stdexcept>	/* std::out_of_range */
+#include <utility>	/* std::pair */
+#include <tuple>	/* std::piecewise_construct */
+#include <new>
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+#include <kay/bits.hh>
+#include <kay/numbers.hh>
+
+namespace kay {
+
+class Zview;
+class Qview;
+
+/* Whether a value of type K can be hashed and compared as is when looking up
+ * a key of type Key, which requires equal values of both types to hash
+ * equally. This does not hold in general, e.g. for int and Z or for int and
+ * double, where lookups convert to Key instead. Specialize to opt in. */
+template <typename K, typename Key>
+struct is_hash_compatible : std::is_same<K,Key> {};
+
+template <> struct is_hash_compatible<Zview,Z> : std::true_type {};
+template <> struct is_hash_compatible<Qview,Q> : std::true_type {};
+
+/* Hash functor through kay::do_hash, covering Z, Q and tuples and vectors of
+ * hashable types. It is transparent for the types that are
+ * is_hash_compatible, e.g. Zview for Z. */
+template <template <typename> typename Std = hash_std_kay>
+struct hasher {
+	using is_transparent = void;
+
+	template <typename T>
+	size_t operator()(const T &v) const noexcept { return do_hash<T,Std>(v); }
+};
+
+namespace flat_detail {
+
+/* Open addressing with one control byte per slot, probed a group of slots at
+ * a time as in Google's Swiss tables. A control byte holds either the 7 low
+ * bits of the hash of a full slot, or one of the values below. */
+using ctrl_t = int8_t;
+inline constexpr ctrl_t EMPTY   = -128;
+inline constexpr ctrl_t DELETED = -2;
+
+inline bool is_full(ctrl_t c) { return c >= 0; }
+
+/* positions of matching slots in a group */
+struct bitmask {
+	uint64_t m;
+	unsigned shift; /* log2 of the bits per slot */
+
+	explicit operator bool() const { return m; }
+	unsigned lowest() const { return __builtin_ctzll(m) >> shift; }
+	unsigned highest() const { return (63 - __builtin_clzll(m)) >> shift; }
+	void next() { m &= m - 1; }
+};
+
+#if defined(__SSE2__)
+struct group {
+	static constexpr size_t width = 16;
+
+	__m128i c;
+
+	explicit group(const ctrl_t *p) : c(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))) {}
+
+	bitmask match(ctrl_t h2) const
+	{
+		return { (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), c)), 0 };
+	}
+
+	bitmask match_empty() const
+	{
+		return { (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(EMPTY), c)), 0 };
+	}
+
+	bitmask match_empty_or_deleted() const
+	{
+		return { (uint32_t)_mm_movemask_epi8(c), 0 };
+	}
+};
+#else
+/* portable version operating on 8 control bytes in a word */
+struct group {
+	static constexpr size_t width = 8;
+	static constexpr uint64_t lsbs = 0x0101010101010101;
+	static constexpr uint64_t msbs = 0x8080808080808080;
+
+	uint64_t c;
+
+	explicit group(const ctrl_t *p)
+	{
+		memcpy(&c, p, sizeof(c));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		c = __builtin_bswap64(c);
+#endif
+	}
+
+	/* may report full slots next to matching ones, which the key comparison
+	 * filters out */
+	bitmask match(ctrl_t h2) const
+	{
+		uint64_t x = c ^ (lsbs * (uint8_t)h2);
+		return { (x - lsbs) & ~x & msbs, 3 };
+	}
+
+	bitmask match_empty() const { return { c & ~(c << 6) & msbs, 3 }; }
+
+	bitmask match_empty_or_deleted() const { return { c & msbs, 3 }; }
+};
+#endif
+
+inline constexpr size_t W = group::width;
+
+/* distributes the bits of h, which for integers is commonly the identity */
+inline size_t mix(size_t h)
+{
+	unsigned __int128 p = (unsigned __int128)h * 0x9e3779b97f4a7c15U;
+	return (uint64_t)p ^ (uint64_t)(p >> 64);
+}
+
+/* maximum load factor 7/8 */
+constexpr size_t growth_of(size_t cap) { return cap - cap / 8; }
+
+template <typename T, typename = void>
+struct is_transparent : std::false_type {};
+template <typename T>
+struct is_transparent<T,std::void_t<typename T::is_transparent>> : std::true_type {};
+
+template <typename Key>
+struct set_policy {
+	using key_type   = Key;
+	using value_type = Key;
+	using slot_type  = Key;
+
+	static const Key & key(const value_type &v) { return v; }
+	static value_type & element(slot_type *s) { return *std::launder(s); }
+
+	template <typename... Args>
+	static void construct(slot_type *s, Args &&... args)
+	{
+		new (s) Key(std::forward<Args>(args)...);
+	}
+
+	static void destroy(slot_type *s) { element(s).~Key(); }
+
+	static void transfer(slot_type *dst, slot_type *src)
+	{
+		construct(dst, std::move(element(src)));
+		destroy(src);
+	}
+};
+
+template <typename Key, typename V>
+struct map_policy {
+	using key_type   = Key;
+	using value_type = std::pair<const Key,V>;
+
+	/* allows moving keys when rehashing */
+	union slot_type {
+		value_type value;
+		std::pair<Key,V> mutable_value;
+		slot_type() {}
+		~slot_type() {}
+	};
+
+	static const Key & key(const value_type &v) { return v.first; }
+	static value_type & element(slot_type *s) { return *std::launder(&s->value); }
+
+	template <typename... Args>
+	static void construct(slot_type *s, Args &&... args)
+	{
+		new (&s->value) value_type(std::forward<Args>(args)...);
+	}
+
+	static void destroy(slot_type *s) { element(s).~value_type(); }
+
+	static void transfer(slot_type *dst, slot_type *src)
+	{
+		auto &m = *std::launder(&src->mutable_value);
+		new (&dst->mutable_value) std::pair<Key,V>(std::move(m));
+		m.~pair();
+	}
+};
+
+template <typename Policy, typename Hash, typename Eq>
+class table {
+
+	using slot_type = typename Policy::slot_type;
+
+public:
+	using key_type        = typename Policy::key_type;
+	using value_type      = typename Policy::value_type;
+	using size_type       = size_t;
+	using hasher          = Hash;
+	using key_equal       = Eq;
+	using reference       = value_type &;
+	using const_reference = const value_type &;
+
+protected:
+	ctrl_t *ctrl = nullptr; /* cap + W bytes, the first W-1 mirrored at cap */
+	slot_type *slots = nullptr;
+	size_t cap = 0; /* 0 or a power of 2 at least W */
+	size_t sz = 0;
+	size_t growth_left = 0;
+	[[no_unique_address]] Hash h;
+	[[no_unique_address]] Eq eq;
+
+	static constexpr bool transparent = is_transparent<Hash>::value &&
+	                                    is_transparent<Eq>::value;
+
+	/* heterogeneous key types are accepted with transparent Hash and Eq if
+	 * they are is_hash_compatible; others are converted to key_type by the
+	 * non-template overloads */
+	template <typename K>
+	using if_lookup_key = std::enable_if_t<std::is_same_v<K,key_type> ||
+	                                       (transparent && is_hash_compatible<K,key_type>::value),int>;
+
+	void set_ctrl(size_t i, ctrl_t c)
+	{
+		ctrl[i] = c;
+		if (i < W - 1)
+			ctrl[cap + i] = c;
+	}
+
+	static ctrl_t h2(size_t hash) { return hash & 0x7f; }
+	static size_t h1(size_t hash) { return hash >> 7; }
+
+	template <typename K>
+	size_t hash_of(const K &k) const { return mix(h(k)); }
+
+	/* index of k or cap */
+	template <typename K>
+	size_t find_index(const K &k, size_t hash) const
+	{
+		if (!cap)
+			return cap;
+		size_t mask = cap - 1, pos = h1(hash) & mask;
+		for (size_t step = 0;; ) {
+			group g(ctrl + pos);
+			for (bitmask m = g.match(h2(hash)); m; m.next()) {
+				size_t i = (pos + m.lowest()) & mask;
+				if (eq(Policy::key(Policy::element(slots + i)), k))
+					return i;
+			}
+			if (g.match_empty())
+				return cap;
+			step += W;
+			pos = (pos + step) & mask;
+		}
+	}
+
+	/* first empty or deleted slot on the probe sequence of hash */
+	size_t find_non_full(size_t hash) const
+	{
+		size_t mask = cap - 1, pos = h1(hash) & mask;
+		for (size_t step = 0;; ) {
+			group g(ctrl + pos);
+			if (bitmask m = g.match_empty_or_deleted())
+				return (pos + m.lowest()) & mask;
+			step += W;
+			pos = (pos + step) & mask;
+		}
+	}
+
+	void allocate(size_t c)
+	{
+		cap = c;
+		ctrl = std::allocator<ctrl_t>().allocate(cap + W);
+		memset(ctrl, EMPTY, cap + W);
+		slots = std::allocator<slot_type>().allocate(cap);
+		growth_left = growth_of(cap) - sz;
+	}
+
+	void deallocate()
+	{
+		if (!cap)
+			return;
+		std::allocator<ctrl_t>().deallocate(ctrl, cap + W);
+		std::allocator<slot_type>().deallocate(slots, cap);
+		ctrl = nullptr;
+		slots = nullptr;
+		cap = 0;
+	}
+
+	void destroy_all()
+	{
+		for (size_t i=0; i<cap; i++)
+			if (is_full(ctrl[i]))
+				Policy::destroy(slots + i);
+	}
+
+	/* moves all elements into a new array of capacity c */
+	void resize(size_t c)
+	{
+		ctrl_t *old_ctrl = ctrl;
+		slot_type *old_slots = slots;
+		size_t old_cap = cap;
+		allocate(c);
+		for (size_t i=0; i<old_cap; i++)
+			if (is_full(old_ctrl[i])) {
+				size_t hash = hash_of(Policy::key(Policy::element(old_slots + i)));
+				size_t j = find_non_full(hash);
+				set_ctrl(j, h2(hash));
+				Policy::transfer(slots + j, old_slots + i);
+			}
+		if (old_cap) {
+			std::allocator<ctrl_t>().deallocate(old_ctrl, old_cap + W);
+			std::allocator<slot_type>().deallocate(old_slots, old_cap);
+		}
+	}
+
+	static size_t normalize(size_t c)
+	{
+		size_t r = W;
+		while (r < c)
+			r *= 2;
+		return r;
+	}
+
+	/* capacity for n elements */
+	static size_t capacity_for(size_t n)
+	{
+		return n ? normalize(n + (n + 6) / 7) : 0;
+	}
+
+	void grow()
+	{
+		/* mostly tombstones: clean up in place */
+		if (cap > W && sz <= cap / 2)
+			resize(cap);
+		else
+			resize(cap ? 2 * cap : W);
+	}
+
+	/* slot for a new element with hash, which is not in the table */
+	size_t prepare_insert(size_t hash)
+	{
+		size_t i = cap ? find_non_full(hash) : 0;
+		if (!cap || (!growth_left && ctrl[i] != DELETED)) {
+			grow();
+			i = find_non_full(hash);
+		}
+		growth_left -= ctrl[i] == EMPTY;
+		set_ctrl(i, h2(hash));
+		sz++;
+		return i;
+	}
+
+	/* (index, whether it was inserted) with a new element constructed by
+	 * cons(slot) */
+	template <typename K, typename F>
+	std::pair<size_t,bool> find_or_insert(const K &k, F &&cons)
+	{
+		size_t hash = hash_of(k);
+		size_t i = find_index(k, hash);
+		if (i != cap)
+			return { i, false };
+		i = prepare_insert(hash);
+		try {
+			cons(slots + i);
+		} catch (...) {
+			set_ctrl(i, DELETED);
+			sz--;
+			throw;
+		}
+		return { i, true };
+	}
+
+	void erase_at(size_t i)
+	{
+		Policy::destroy(slots + i);
+		sz--;
+		/* Slot i may become empty if no probe sequence continued past a
+		 * group containing it, i.e., if fewer than W consecutive slots
+		 * around i are not empty. */
+		size_t before = (i - W) & (cap - 1);
+		bitmask ea = group(ctrl + i).match_empty();
+		bitmask eb = group(ctrl + before).match_empty();
+		if (ea && eb && ea.lowest() + (W - 1 - eb.highest()) < W) {
+			set_ctrl(i, EMPTY);
+			growth_left++;
+		} else
+			set_ctrl(i, DELETED);
+	}
+
+	/* into an empty table; if copying an element throws, the table is left
+	 * empty without storage, which lets the copy constructor, whose
+	 * destructor does not run then, release everything */
+	void copy_from(const table &o)
+	{
+		try {
+			reserve(o.sz);
+			for (size_t i=0; i<o.cap; i++)
+				if (is_full(o.ctrl[i])) {
+					const value_type &v = Policy::element(o.slots + i);
+					size_t j = prepare_insert(hash_of(Policy::key(v)));
+					try {
+						Policy::construct(slots + j, v);
+					} catch (...) {
+						set_ctrl(j, DELETED);
+						throw;
+					}
+				}
+		} catch (...) {
+			destroy_all();
+			deallocate();
+			sz = growth_left = 0;
+			throw;
+		}
+	}
+
+public:
+	template <bool is_const>
+	class basic_iterator {
+		friend class table;
+
+		using ctrl_p = const ctrl_t *;
+		using slot_p = std::conditional_t<is_const,const slot_type *,slot_type *>;
+
+		ctrl_p c = nullptr, e = nullptr;
+		slot_p s = nullptr;
+
+		basic_iterator(ctrl_p c, ctrl_p e, slot_p s) : c(c), e(e), s(s) { skip(); }
+
+		void skip()
+		{
+			while (c != e && !is_full(*c))
+				++c, ++s;
+		}
+
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type        = typename table::value_type;
+		using difference_type   = ptrdiff_t;
+		using reference         = std::conditional_t<is_const,const value_type &,value_type &>;
+		using pointer           = std::conditional_t<is_const,const value_type *,value_type *>;
+
+		basic_iterator() = default;
+		template <bool other_const, typename = std::enable_if_t<is_const && !other_const>>
+		basic_iterator(const basic_iterator<other_const> &o) : c(o.c), e(o.e), s(o.s) {}
+
+		reference operator*() const { return Policy::element(const_cast<slot_type *>(s)); }
+		pointer operator->() const { return &**this; }
+
+		basic_iterator & operator++() { ++c; ++s; skip(); return *this; }
+		basic_iterator operator++(int) { basic_iterator r = *this; ++*this; return r; }
+
+		friend bool operator==(const basic_iterator &a, const basic_iterator &b) { return a.c == b.c; }
+		friend bool operator!=(const basic_iterator &a, const basic_iterator &b) { return a.c != b.c; }
+
+		template <bool> friend class basic_iterator;
+	};
+
+	using iterator       = basic_iterator<false>;
+	using const_iterator = basic_iterator<true>;
+
+protected:
+	iterator       iterator_at(size_t i)       { return { ctrl + i, ctrl + cap, slots + i }; }
+	const_iterator iterator_at(size_t i) const { return { ctrl + i, ctrl + cap, slots + i }; }
+
+public:
+	table() = default;
+	explicit table(size_t n, const Hash &h = Hash(), const Eq &eq = Eq())
+	: h(h), eq(eq)
+	{ reserve(n); }
+
+	table(const table &o) : h(o.h), eq(o.eq) { copy_from(o); }
+
+	table(table &&o) noexcept
+	: ctrl(o.ctrl), slots(o.slots), cap(o.cap), sz(o.sz)
+	, growth_left(o.growth_left), h(std::move(o.h)), eq(std::move(o.eq))
+	{
+		o.ctrl = nullptr;
+		o.slots = nullptr;
+		o.cap = o.sz = o.growth_left = 0;
+	}
+
+	~table() { destroy_all(); deallocate(); }
+
+	table & operator=(const table &o)
+	{
+		if (this != &o) {
+			clear();
+			h = o.h;
+			eq = o.eq;
+			copy_from(o);
+		}
+		return *this;
+	}
+
+	table & operator=(table &&o) noexcept
+	{
+		swap(*this, o);
+		return *this;
+	}
+
+	friend void swap(table &a, table &b) noexcept
+	{
+		using std::swap;
+		swap(a.ctrl, b.ctrl);
+		swap(a.slots, b.slots);
+		swap(a.cap, b.cap);
+		swap(a.sz, b.sz);
+		swap(a.growth_left, b.growth_left);
+		swap(a.h, b.h);
+		swap(a.eq, b.eq);
+	}
+
+	size_t size() const { return sz; }
+	bool empty() const { return !sz; }
+	size_t capacity() const { return cap; }
+	size_t bucket_count() const { return cap; }
+	float load_factor() const { return cap ? (float)sz / cap : 0; }
+	float max_load_factor() const { return 7.0f / 8; }
+
+	hasher hash_function() const { return h; }
+	key_equal key_eq() const { return eq; }
+
+	iterator begin() { return iterator_at(0); }
+	iterator end() { return iterator_at(cap); }
+	const_iterator begin() const { return iterator_at(0); }
+	const_iterator end() const { return iterator_at(cap); }
+	const_iterator cbegin() const { return begin(); }
+	const_iterator cend() const { return end(); }
+
+	/* destroys all elements and keeps the capacity */
+	void clear()
+	{
+		destroy_all();
+		if (cap)
+			memset(ctrl, EMPTY, cap + W);
+		sz = 0;
+		growth_left = growth_of(cap);
+	}
+
+	/* space for n elements without rehashing */
+	void reserve(size_t n)
+	{
+		if (n > sz + growth_left)
+			resize(capacity_for(n));
+	}
+
+	/* capacity at least n and sufficient for size(); rehash(0) shrinks */
+	void rehash(size_t n)
+	{
+		size_t c = std::max(n ? normalize(n) : 0, capacity_for(sz));
+		if (!c) {
+			deallocate();
+			growth_left = 0;
+		} else if (c != cap || growth_left != growth_of(cap) - sz)
+			resize(c);
+	}
+
+	template <typename K = key_type, if_lookup_key<K> = 0>
+	iterator find(const K &k)
+	{
+		size_t i = find_index(k, hash_of(k));
+		return i == cap ? end() : iterator_at(i);
+	}
+
+	template <typename K = key_type, if_lookup_key<K> = 0>
+	const_iterator find(const K &k) const
+	{
+		size_t i = find_index(k, hash_of(k));
+		return i == cap ? end() : iterator_at(i);
+	}
+
+	iterator find(const key_type &k) { return find<key_type>(k); }
+	const_iterator find(const key_type &k) const { return find<key_type>(k); }
+
+	template <typename K = key_type, if_lookup_key<K> = 0>
+	bool contains(const K &k) const { return find_index(k, hash_of(k)) != cap; }
+	bool contains(const key_type &k) const { return contains<key_type>(k); }
+
+	template <typename K = key_type, if_lookup_key<K> = 0>
+	size_t count(const K &k) const { return contains(k); }
+	size_t count(const key_type &k) const { return contains(k); }
+
+	iterator erase(const_iterator it)
+	{
+		size_t i = it.c - ctrl;
+		erase_at(i);
+		return iterator_at(i + 1);
+	}
+
+	iterator erase(iterator it) { return erase(const_iterator(it)); }
+
+	template <typename K = key_type, if_lookup_key<K> = 0>
+	size_t erase(const K &k)
+	{
+		size_t i = find_index(k, hash_of(k));
+		if (i == cap)
+			return 0;
+		erase_at(i);
+		return 1;
+	}
+
+	size_t erase(const key_type &k) { return erase<key_type>(k); }
+
+	friend bool operator==(const table &a, const table &b)
+	{
+		if (a.sz != b.sz)
+			return false;
+		for (const value_type &v : a) {
+			auto it = b.find(Policy::key(v));
+			if (it == b.end() || !(*it == v))
+				return false;
+		}
+		return true;
+	}
+
+	friend bool operator!=(const table &a, const table &b) { return !(a == b); }
+};
+
+}
+
+/* Flat hash set with open addressing. Elements are stored in a single array
+ * and move when the table grows: iterators and references are invalidated by
+ * insertions. */
+template <typename K, typename Hash = hasher<>, typename Eq = std::equal_to<>>
+class flat_hash_set : public flat_detail::table<flat_detail::set_policy<K>,Hash,Eq> {
+
+	using base = flat_detail::table<flat_detail::set_policy<K>,Hash,Eq>;
+	using P = flat_detail::set_policy<K>;
+
+public:
+	using typename base::iterator;
+	using typename base::const_iterator;
+	using typename base::value_type;
+
+	using base::base;
+
+	flat_hash_set(std::initializer_list<K> l) : base(l.size()) { insert(l.begin(), l.end()); }
+
+	std::pair<iterator,bool> insert(const K &k)
+	{
+		auto [i, ins] = this->find_or_insert(k, [&](auto *s){ P::construct(s, k); });
+		return { this->iterator_at(i), ins };
+	}
+
+	std::pair<iterator,bool> insert(K &&k)
+	{
+		auto [i, ins] = this->find_or_insert(k, [&](auto *s){ P::construct(s, std::move(k)); });
+		return { this->iterator_at(i), ins };
+	}
+
+	template <typename It>
+	void insert(It first, It last)
+	{
+		for (; first != last; ++first)
+			insert(*first);
+	}
+
+	template <typename... Args>
+	std::pair<iterator,bool> emplace(Args &&... args)
+	{
+		return insert(K(std::forward<Args>(args)...));
+	}
+};
+
+/* Flat hash map with open addressing, see flat_hash_set. */
+template <typename K, typename V, typename Hash = hasher<>, typename Eq = std::equal_to<>>
+class flat_hash_map : public flat_detail::table<flat_detail::map_policy<K,V>,Hash,Eq> {
+
+	using base = flat_detail::table<flat_detail::map_policy<K,V>,Hash,Eq>;
+	using P = flat_detail::map_policy<K,V>;
+
+public:
+	using typename base::iterator;
+	using typename base::const_iterator;
+	using typename base::value_type;
+	using mapped_type = V;
+
+	using base::base;
+
+	flat_hash_map(std::initializer_list<value_type> l) : base(l.size()) { insert(l.begin(), l.end()); }
+
+	template <typename... Args>
+	std::pair<iterator,bool> try_emplace(const K &k, Args &&... args)
+	{
+		auto [i, ins] = this->find_or_insert(k, [&](auto *s){
+			P::construct(s, std::piecewise_construct,
+			             std::forward_as_tuple(k),
+			             std::forward_as_tuple(std::forward<Args>(args)...));
+		});
+		return { this->iterator_at(i), ins };
+	}
+
+	template <typename... Args>
+	std::pair<iterator,bool> try_emplace(K &&k, Args &&... args)
+	{
+		auto [i, ins] = this->find_or_insert(k, [&](auto *s){
+			P::construct(s, std::piecewise_construct,
+			             std::forward_as_tuple(std::move(k)),
+			             std::forward_as_tuple(std::forward<Args>(args)...));
+		});
+		return { this->iterator_at(i), ins };
+	}
+
+	std::pair<iterator,bool> insert(const value_type &v) { return try_emplace(v.first, v.second); }
+	std::pair<iterator,bool> insert(value_type &&v) { return try_emplace(std::move(const_cast<K &>(v.first)), std::move(v.second)); }
+
+	template <typename It>
+	void insert(It first, It last)
+	{
+		for (; first != last; ++first)
+			insert(*first);
+	}
+
+	template <typename M>
+	std::pair<iterator,bool> insert_or_assign(const K &k, M &&m)
+	{
+		auto r = try_emplace(k, std::forward<M>(m));
+		if (!r.second)
+			r.first->second = std::forward<M>(m);
+		return r;
+	}
+
+	template <typename... Args>
+	std::pair<iterator,bool> emplace(Args &&... args)
+	{
+		std::pair<K,V> v(std::forward<Args>(args)...);
+		return try_emplace(std::move(v.first), std::move(v.second));
+	}
+
+	V & operator[](const K &k) { return try_emplace(k).first->second; }
+	V & operator[](K &&k) { return try_emplace(std::move(k)).first->second; }
+
+	template <typename Key = K, typename base::template if_lookup_key<Key> = 0>
+	V & at(const Key &k)
+	{
+		auto it = this->find(k);
+		if (it == this->end())
+			throw std::out_of_range("kay::flat_hash_map::at");
+		return it->second;
+	}
+
+	template <typename Key = K, typename base::template if_lookup_key<Key> = 0>
+	const V & at(const Key &k) const
+	{
+		auto it = this->find(k);
+		if (it == this->end())
+			throw std::out_of_range("kay::flat_hash_map::at");
+		return it->second;
+	}
+
+	V & at(const K &k) { return at<K>(k); }
+	const V & at(const K &k) const { return at<K>(k); }
+};
+
+}
+
+#endif
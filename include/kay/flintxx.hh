@@ -24,34 +24,66 @@
 #include <flint/fmpz.h>
 #include <flint/fmpq.h>
 
+#include <kay/instrument.hh>
+
 namespace kay::flintxx {
 
+/* counts instrument::promote if the fmpz changed from small to mpz during
+ * the lifetime of this object */
+class promotion_scope {
+#if (KAY_INSTRUMENT-0)
+	const fmpz *f;
+	bool small;
+public:
+	explicit promotion_scope(const fmpz *f) : f(f), small(!COEFF_IS_MPZ(*f)) {}
+	~promotion_scope() { if (small && COEFF_IS_MPZ(*f)) instrument::count(instrument::promote); }
+#else
+public:
+	explicit promotion_scope(const fmpz *) {}
+#endif
+	promotion_scope(const promotion_scope &) = delete;
+};
+
 class Z {
 
 	fmpz z;
 
 public:
-	Z()           noexcept   { fmpz_init(get_fmpz_t()); }
-	Z(const Z &v) noexcept   { fmpz_init_set(get_fmpz_t(), v.get_fmpz_t()); }
-	Z(Z &&v)      noexcept   : z(v.z) { v.z = 0; /* flint internals: 0 is not alloc'ed */ }
+	/* The constructors delegating to Z() are counted as constructions by
+	 * it. Values not fitting a small fmpz count as promotions. */
+	Z()           noexcept   { fmpz_init(get_fmpz_t()); instrument::count(instrument::construct); }
+	Z(const Z &v) noexcept
+	{
+		fmpz_init_set(get_fmpz_t(), v.get_fmpz_t());
+		instrument::count(instrument::copy);
+		if (COEFF_IS_MPZ(z))
+			instrument::count(instrument::promote);
+	}
+	Z(Z &&v)      noexcept   : z(v.z) { v.z = 0; /* flint internals: 0 is not alloc'ed */ instrument::count(instrument::move); }
 
 #if COEFF_MIN <= INT_MIN && INT_MAX <= COEFF_MAX
-	Z(signed v)              : z(v) {}
+	Z(signed v)              : z(v) { instrument::count(instrument::construct); }
 #else
 	Z(signed v)              : Z(static_cast<signed long>(v)) {}
 #endif
 #if COEFF_MIN <= UINT_MIN && UINT_MAX <= COEFF_MAX
-	Z(unsigned v)            : z(v) {}
+	Z(unsigned v)            : z(v) { instrument::count(instrument::construct); }
 #else
 	Z(unsigned v)            : Z(static_cast<unsigned long>(v)) {}
 #endif
-	Z(signed long v)         : Z() { fmpz_set_si(get_fmpz_t(), v); }
-	Z(unsigned long v)             { fmpz_init_set_ui(get_fmpz_t(), v); }
-	explicit Z(mpz_srcptr v) : Z() { fmpz_set_mpz(get_fmpz_t(), v); }
+	Z(signed long v)         : Z() { promotion_scope p(&z); fmpz_set_si(get_fmpz_t(), v); }
+	Z(unsigned long v)
+	{
+		fmpz_init_set_ui(get_fmpz_t(), v);
+		instrument::count(instrument::construct);
+		if (COEFF_IS_MPZ(z))
+			instrument::count(instrument::promote);
+	}
+	explicit Z(mpz_srcptr v) : Z() { promotion_scope p(&z); fmpz_set_mpz(get_fmpz_t(), v); }
 	Z(const mpz_class &v)    : Z(v.get_mpz_t()) {}
 
 	explicit Z(const char *s, int base=10)
-	: Z() { fmpz_set_str(get_fmpz_t(), s, base); }
+	: Z() { promotion_scope p(&z); fmpz_set_str(get_fmpz_t(), s, base); }
 
 	explicit Z(const std::string &s, int base=10)
 	: Z(s.c_str(), base)
@@ -64,8 +96,14 @@ public:
 		fmpz_swap(a.get_fmpz_t(), b.get_fmpz_t());
 	}
 
-	Z & operator=(const Z &v) noexcept { fmpz_set(get_fmpz_t(), v.get_fmpz_t()); return *this; }
-	Z & operator=(Z &&v)      noexcept { swap(*this, v); return *this; }
+	Z & operator=(const Z &v) noexcept
+	{
+		promotion_scope p(&z);
+		fmpz_set(get_fmpz_t(), v.get_fmpz_t());
+		instrument::count(instrument::copy);
+		return *this;
+	}
+	Z & operator=(Z &&v)      noexcept { swap(*this, v); instrument::count(instrument::move); return *this; }
 
 	      fmpz * get_fmpz_t()       { return &z; }
 	const fmpz * get_fmpz_t() const { return &z; }
@@ -103,15 +141,15 @@ public:
 	Z   operator--(int) { Z old = *this; --*this; return old; }
 
 	friend Z & operator+=(Z &a, const Z &b)
-	{ fmpz_add(a.get_fmpz_t(), a.get_fmpz_t(), b.get_fmpz_t()); return a; }
+	{ promotion_scope p(&a.z); fmpz_add(a.get_fmpz_t(), a.get_fmpz_t(), b.get_fmpz_t()); return a; }
 	friend Z   operator+ (Z  a, const Z &b) { a += b; return a; }
 
 	friend Z & operator-=(Z &a, const Z &b)
-	{ fmpz_sub(a.get_fmpz_t(), a.get_fmpz_t(), b.get_fmpz_t()); return a; }
+	{ promotion_scope p(&a.z); fmpz_sub(a.get_fmpz_t(), a.get_fmpz_t(), b.get_fmpz_t()); return a; }
 	friend Z   operator- (Z  a, const Z &b) { a -= b; return a; }
 
 	friend Z & operator*=(Z &a, const Z &b)
-	{ fmpz_mul(a.get_fmpz_t(), a.get_fmpz_t(), b.get_fmpz_t()); return a; }
+	{ promotion_scope p(&a.z); fmpz_mul(a.get_fmpz_t(), a.get_fmpz_t(), b.get_fmpz_t()); return a; }
 	friend Z   operator* (Z  a, const Z &b) { a *= b; return a; }
 
 	friend Z & operator/=(Z &a, const Z &b)
@@ -136,7 +174,7 @@ public:
 	}
 
 	friend Z & operator<<=(Z &a, mp_bitcnt_t e)
-	{ fmpz_mul_2exp(a.get_fmpz_t(), a.get_fmpz_t(), e); return a; }
+	{ promotion_scope p(&a.z); fmpz_mul_2exp(a.get_fmpz_t(), a.get_fmpz_t(), e); return a; }
 	friend Z   operator<< (Z  a, mp_bitcnt_t e) { a <<= e; return a; }
 
 	friend Z & operator>>=(Z &a, mp_bitcnt_t e)
@@ -172,7 +210,7 @@ public:
 		return COEFF_IS_MPZ(z) ? mpz_get_si(COEFF_TO_PTR(z)) : z;
 	}
 
-	friend Z   pow(Z a, unsigned long x) { fmpz_pow_ui(a.get_fmpz_t(), a.get_fmpz_t(), x); return a; }
+	friend Z   pow(Z a, unsigned long x) { promotion_scope p(&a.z); fmpz_pow_ui(a.get_fmpz_t(), a.get_fmpz_t(), x); return a; }
 	friend Z   abs(Z a)                  { fmpz_abs(a.get_fmpz_t(), a.get_fmpz_t()); return a; }
 	friend Z   gcd(Z a, const Z &b)      { fmpz_gcd(a.get_fmpz_t(), a.get_fmpz_t(), b.get_fmpz_t()); return a; }
 
@@ -232,6 +270,11 @@ struct Q {
 	Z num;
 	Z den;
 
+	struct promotions {
+		promotion_scope n, d;
+		explicit promotions(const Q &a) : n(a.num.get_fmpz_t()), d(a.den.get_fmpz_t()) {}
+	};
+
 	Q()           noexcept : num(), den(1U) {}
 	Q(const Q &v) noexcept = default;
 	Q(Q &&v)      noexcept = default;
@@ -279,7 +322,14 @@ struct Q {
 
 	friend void swap(Q &a, Q &b) { fmpq_swap(a.get_fmpq_t(), b.get_fmpq_t()); }
 
-	Q & operator=(const Q &v) { fmpq_set(get_fmpq_t(), v.get_fmpq_t()); return *this; }
+	Q & operator=(const Q &v)
+	{
+		promotions p(*this);
+		fmpq_set(get_fmpq_t(), v.get_fmpq_t());
+		instrument::count(instrument::copy);
+		instrument::count(instrument::copy);
+		return *this;
+	}
 	Q & operator=(Q &&v) = default;
 
 	constexpr       Z & get_num()       { return num; }
@@ -290,7 +340,11 @@ struct Q {
 	      fmpq * get_fmpq_t()       { return reinterpret_cast<fmpq *>(this); }
 	const fmpq * get_fmpq_t() const { return reinterpret_cast<const fmpq *>(this); }
 
-	friend void canonicalize(Q &a) { fmpq_canonicalise(a.get_fmpq_t()); }
+	friend void canonicalize(Q &a)
+	{
+		fmpq_canonicalise(a.get_fmpq_t());
+		instrument::count(instrument::canonicalize);
+	}
 
 	explicit operator bool() const { return !fmpq_is_zero(get_fmpq_t()); }
 
@@ -313,23 +367,23 @@ struct Q {
 	Q   operator--(int) { Q old = *this; --*this; return old; }
 
 	friend Q & operator+=(Q &a, const Q &b)
-	{ fmpq_add(a.get_fmpq_t(), a.get_fmpq_t(), b.get_fmpq_t()); return a; }
+	{ promotions p(a); fmpq_add(a.get_fmpq_t(), a.get_fmpq_t(), b.get_fmpq_t()); return a; }
 	friend Q   operator+ (Q  a, const Q &b) { a += b; return a; }
 
 	friend Q & operator-=(Q &a, const Q &b)
-	{ fmpq_sub(a.get_fmpq_t(), a.get_fmpq_t(), b.get_fmpq_t()); return a; }
+	{ promotions p(a); fmpq_sub(a.get_fmpq_t(), a.get_fmpq_t(), b.get_fmpq_t()); return a; }
 	friend Q   operator- (Q  a, const Q &b) { a -= b; return a; }
 
 	friend Q & operator*=(Q &a, const Q &b)
-	{ fmpq_mul(a.get_fmpq_t(), a.get_fmpq_t(), b.get_fmpq_t()); return a; }
+	{ promotions p(a); fmpq_mul(a.get_fmpq_t(), a.get_fmpq_t(), b.get_fmpq_t()); return a; }
 	friend Q   operator* (Q  a, const Q &b) { a *= b; return a; }
 
 	friend Q & operator/=(Q &a, const Q &b)
-	{ fmpq_div(a.get_fmpq_t(), a.get_fmpq_t(), b.get_fmpq_t()); return a; }
+	{ promotions p(a); fmpq_div(a.get_fmpq_t(), a.get_fmpq_t(), b.get_fmpq_t()); return a; }
 	friend Q   operator/ (Q  a, const Q &b) { a /= b; return a; }
 
 	friend Q & operator<<=(Q &a, mp_bitcnt_t e)
-	{ fmpq_mul_2exp(a.get_fmpq_t(), a.get_fmpq_t(), e); return a; }
+	{ promotions p(a); fmpq_mul_2exp(a.get_fmpq_t(), a.get_fmpq_t(), e); return a; }
 	friend Q   operator<< (Q  a, mp_bitcnt_t e) { a <<= e; return a; }
 
 	friend Q & operator>>=(Q &a, mp_bitcnt_t e)
@@ -337,9 +391,9 @@ struct Q {
 	friend Q   operator>> (Q  a, mp_bitcnt_t e) { a >>= e; return a; }
 
 	friend void fma(Q &r, const Q &a, const Q &b)
-	{ fmpq_addmul(r.get_fmpq_t(), a.get_fmpq_t(), b.get_fmpq_t()); }
+	{ promotions p(r); fmpq_addmul(r.get_fmpq_t(), a.get_fmpq_t(), b.get_fmpq_t()); }
 	friend void fms(Q &r, const Q &a, const Q &b)
-	{ fmpq_submul(r.get_fmpq_t(), a.get_fmpq_t(), b.get_fmpq_t()); }
+	{ promotions p(r); fmpq_submul(r.get_fmpq_t(), a.get_fmpq_t(), b.get_fmpq_t()); }
 
 	friend int  sgn(const Q &a)
 	{
@@ -351,7 +405,7 @@ struct Q {
 	friend Q    inv(Q a)                    { fmpq_inv(a.get_fmpq_t(), a.get_fmpq_t()); return a; }
 	friend Q    abs(Q a)                    { fmpq_abs(a.get_fmpq_t(), a.get_fmpq_t()); return a; }
 	friend Q    gcd(Q a, const Q &b)        { fmpq_gcd(a.get_fmpq_t(), a.get_fmpq_t(), b.get_fmpq_t()); return a; }
-	friend Q    pow(Q a, signed long e)     { fmpq_pow_si(a.get_fmpq_t(), a.get_fmpq_t(), e); return a; }
+	friend Q    pow(Q a, signed long e)     { promotions p(a); fmpq_pow_si(a.get_fmpq_t(), a.get_fmpq_t(), e); return a; }
 
 	friend bool operator==(const Q &a, const Q &b) { return cmp(a, b) == 0; }
 #if __cpp_impl_three_way_comparison
@@ -384,6 +438,7 @@ struct Q {
 	/* truncates, i.e. rounds towards zero */
 	double get_d() const
 	{
+		instrument::count(instrument::get_d);
 		/* TODO: inefficient */
 		return static_cast<mpq_class>(*this).get_d();
 	}
@@ -433,6 +488,19 @@ struct Q {
 
 static_assert(sizeof(Q) == sizeof(fmpq));
 
+/* A canonical fmpz referring to the integer *v without copying its limbs when
+ * it is not small. It is valid as long as *v is and must only be read, never
+ * be modified or cleared. */
+inline fmpz fmpz_view(mpz_srcptr v)
+{
+	int s = v->_mp_size;
+	if (s == 0)
+		return 0;
+	if ((s == 1 || s == -1) && v->_mp_d[0] <= (mp_limb_t)COEFF_MAX)
+		return s < 0 ? -(slong)v->_mp_d[0] : (slong)v->_mp_d[0];
+	return PTR_TO_COEFF(const_cast<mpz_ptr>(v));
+}
+
 static_assert(std::is_standard_layout_v<Z>);
 static_assert(std::is_standard_layout_v<Q>);
 
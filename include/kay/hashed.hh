@@ -0,0 +1,134 @@
+/*
+ * hashed.hh
+ *
+ * Copyright 2018-2022 Franz Brauße <fb@paxle.org>
+ *
+ * See the LICENSE file for terms of distribution.
+ */
+
+#ifndef KAY_HASHED_HH
+#define KAY_HASHED_HH
+
+#include <cmath>	/* std::nextafter, std::isinf */
+#include <cfloat>	/* DBL_MAX */
+#include <functional>	/* std::hash */
+#include <type_traits>
+
+#include <kay/numbers.hh>
+#include <kay/numbits.hh>	/* is_exact_double, detail::mpz_of */
+#include <kay/dbl-ival.hh>
+
+namespace kay {
+
+/* Immutable Z or Q together with its std::hash, its double approximation
+ * (truncated towards zero) and a dbl::ival enclosure, all computed once on
+ * construction. The enclosure is a point if the value is a double and an
+ * interval of one ulp otherwise.
+ *
+ * Equality first rejects on differing hashes or doubles, orderings decide by
+ * the enclosures where they are disjoint; only the remaining cases compare
+ * the values exactly. None of the operations depends on the rounding mode. */
+template <typename T>
+class hashed {
+
+	static_assert(std::is_same_v<T,Z> || std::is_same_v<T,Q>);
+
+	T v;
+	size_t h;
+	double d;
+	dbl::ival iv;
+
+	static double trunc_d(const Z &v)
+	{
+#if (KAY_USE_FLINT-0)
+		__mpz_struct t;
+		mp_limb_t l;
+		return mpz_get_d(detail::mpz_of(*v.get_fmpz_t(), t, l));
+#else
+		return mpz_get_d(v.get_mpz_t());
+#endif
+	}
+
+	static double trunc_d(const Q &v)
+	{
+#if (KAY_USE_FLINT-0)
+		__mpq_struct q;
+		__mpz_struct tn, td;
+		mp_limb_t ln, ld;
+		const fmpq *p = v.get_fmpq_t();
+		q._mp_num = *detail::mpz_of(p->num, tn, ln);
+		q._mp_den = *detail::mpz_of(p->den, td, ld);
+		return mpq_get_d(&q);
+#else
+		return mpq_get_d(v.get_mpq_t());
+#endif
+	}
+
+	void init()
+	{
+		h = std::hash<T>{}(v);
+		d = trunc_d(v);
+		int s = sgn(v);
+		if (std::isinf(d))
+			iv = dbl::ival(dbl::endpts { s < 0 ? -INFINITY : DBL_MAX,
+			                             s < 0 ? -DBL_MAX : INFINITY });
+		else if (!s || is_exact_double(v))
+			iv = dbl::ival(d);
+		else if (s < 0)
+			iv = dbl::ival(dbl::endpts { std::nextafter(d, -INFINITY), d });
+		else
+			iv = dbl::ival(dbl::endpts { d, std::nextafter(d, INFINITY) });
+	}
+
+public:
+	hashed() : hashed(T()) {}
+	explicit hashed(T v) : v(std::move(v)) { init(); }
+
+	const T & get() const { return v; }
+	operator const T &() const { return v; }
+
+	size_t hash() const { return h; }
+	double get_d() const { return d; }
+	const dbl::ival & enclosure() const { return iv; }
+
+	friend int sgn(const hashed &a) { return sgn(a.v); }
+
+	friend bool operator==(const hashed &a, const hashed &b)
+	{
+		return a.h == b.h && a.d == b.d && a.v == b.v;
+	}
+
+	friend bool operator!=(const hashed &a, const hashed &b) { return !(a == b); }
+
+	friend int cmp(const hashed &a, const hashed &b)
+	{
+		if (int c = cmp(a.iv, b.iv))
+			return c;
+		int c = cmp(a.v, b.v);
+		return c < 0 ? -1 : c > 0 ? +1 : 0;
+	}
+
+	friend bool operator< (const hashed &a, const hashed &b) { return cmp(a, b) <  0; }
+	friend bool operator<=(const hashed &a, const hashed &b) { return cmp(a, b) <= 0; }
+	friend bool operator> (const hashed &a, const hashed &b) { return cmp(a, b) >  0; }
+	friend bool operator>=(const hashed &a, const hashed &b) { return cmp(a, b) >= 0; }
+
+	friend std::ostream & operator<<(std::ostream &os, const hashed &a) { return os << a.v; }
+};
+
+using hashed_Z = hashed<Z>;
+using hashed_Q = hashed<Q>;
+
+}
+
+namespace std {
+
+/* the cached hash, equal to that of the value */
+template <typename T>
+struct hash<kay::hashed<T>> {
+	size_t operator()(const kay::hashed<T> &v) const noexcept { return v.hash(); }
+};
+
+}
+
+#endif
@@ -0,0 +1,191 @@
+/*
+ * instrument.hh
+ *
+ * Copyright 2018-2022 Franz Brauße <fb@paxle.org>
+ *
+ * See the LICENSE file for terms of distribution.
+ */
+
+#ifndef KAY_INSTRUMENT_HH
+#define KAY_INSTRUMENT_HH
+
+#include <cstdint>
+#include <atomic>
+#include <vector>
+#include <utility>	/* std::pair */
+#include <ostream>
+
+#include <kay/per-thread.hh>
+
+/* Counters of events in the number types, enabled by compiling with
+ * KAY_INSTRUMENT=1, which then has to hold for all translation units. When
+ * disabled, count() is empty and the counts read are zero.
+ *
+ * Each thread increments its own counters without synchronization beyond
+ * relaxed atomic loads and stores; reading them from another thread yields the
+ * state at some recent point. The counts of threads that have exited are
+ * kept. */
+
+namespace kay::instrument {
+
+enum event : unsigned {
+	construct,    /* Z constructed other than by copy or move */
+	copy,         /* Z copy-constructed or -assigned */
+	move,         /* Z move-constructed or -assigned */
+	promote,      /* Z allocated an mpz: a small one grew or a large one was copied */
+	canonicalize, /* canonicalize(Q &) */
+	get_d,        /* Q::get_d(), flint only */
+	parse,        /* Q_from_str() and the from_chars() of Z, Q and dbl::ival */
+	n_events
+};
+
+/* The events on Z and get_d are only observable for the flint backend,
+ * where the wrappers are kay's; a Q is counted as its numerator and
+ * denominator. With gmpxx only canonicalize and parse are counted. */
+
+inline const char * name(event e)
+{
+	switch (e) {
+	case construct: return "construct";
+	case copy: return "copy";
+	case move: return "move";
+	case promote: return "promote";
+	case canonicalize: return "canonicalize";
+	case get_d: return "get_d";
+	case parse: return "parse";
+	case n_events: break;
+	}
+	return "?";
+}
+
+#if (KAY_INSTRUMENT-0)
+constexpr bool enabled = true;
+#else
+constexpr bool enabled = false;
+#endif
+
+struct counts {
+	uint64_t n[n_events] = {};
+
+	uint64_t   operator[](event e) const { return n[e]; }
+	uint64_t & operator[](event e)       { return n[e]; }
+
+	friend counts & operator+=(counts &a, const counts &b)
+	{
+		for (unsigned i=0; i<n_events; i++)
+			a.n[i] += b.n[i];
+		return a;
+	}
+	friend counts operator+(counts a, const counts &b) { a += b; return a; }
+
+	/* events between two readings b and a */
+	friend counts & operator-=(counts &a, const counts &b)
+	{
+		for (unsigned i=0; i<n_events; i++)
+			a.n[i] -= b.n[i];
+		return a;
+	}
+	friend counts operator-(counts a, const counts &b) { a -= b; return a; }
+
+	/* one "name count" per line */
+	friend std::ostream & operator<<(std::ostream &os, const counts &c)
+	{
+		for (unsigned i=0; i<n_events; i++)
+			os << name(event(i)) << " " << c.n[i] << "\n";
+		return os;
+	}
+};
+
+namespace detail {
+
+struct block {
+	std::atomic<uint64_t> n[n_events] = {};
+
+	counts get() const
+	{
+		counts c;
+		for (unsigned i=0; i<n_events; i++)
+			c.n[i] = n[i].load(std::memory_order_relaxed);
+		return c;
+	}
+
+	void clear()
+	{
+		for (unsigned i=0; i<n_events; i++)
+			n[i].store(0, std::memory_order_relaxed);
+	}
+
+	void retire(counts &exited) const { exited += get(); }
+};
+
+using threads = kay::detail::per_thread<block,counts>;
+
+}
+
+inline void count([[maybe_unused]] event e) noexcept
+{
+#if (KAY_INSTRUMENT-0)
+	std::atomic<uint64_t> &c = detail::threads::local().n[e];
+	c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+#endif
+}
+
+/* the calling thread's counts */
+inline counts thread_counts()
+{
+	if constexpr (!enabled)
+		return {};
+	return detail::threads::local().get();
+}
+
+/* the sum over all threads */
+inline counts total_counts()
+{
+	if constexpr (!enabled)
+		return {};
+	counts c;
+	detail::threads::visit([&](const counts &e){ c = e; },
+	                       [&](unsigned, const detail::block &b){ c += b.get(); });
+	return c;
+}
+
+/* Sets all counts to zero. Events counted concurrently by other threads may
+ * be lost or kept; taking the difference of two total_counts() is exact. */
+inline void reset()
+{
+	if constexpr (!enabled)
+		return;
+	detail::threads::visit([](counts &e){ e = {}; },
+	                       [](unsigned, detail::block &b){ b.clear(); });
+}
+
+/* A table of the counts of each running thread, of those exited and the
+ * total, one event per row. */
+inline void report(std::ostream &os)
+{
+	if constexpr (!enabled) {
+		os << "kay: instrumentation disabled, compile with KAY_INSTRUMENT=1\n";
+		return;
+	}
+	counts exited;
+	std::vector<std::pair<unsigned,counts>> running;
+	detail::threads::visit([&](const counts &e){ exited = e; },
+	                       [&](unsigned id, const detail::block &b){ running.emplace_back(id, b.get()); });
+	counts total = exited;
+	os << "event";
+	for (const auto &[id,c] : running) {
+		os << "\tthread " << id;
+		total += c;
+	}
+	os << "\texited\ttotal\n";
+	for (unsigned i=0; i<n_events; i++) {
+		os << name(event(i));
+		for (const auto &[id,c] : running)
+			os << "\t" << c.n[i];
+		os << "\t" << exited.n[i] << "\t" << total.n[i] << "\n";
+	}
+}
+
+}
+
+#endif
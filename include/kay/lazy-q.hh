@@ -0,0 +1,233 @@
+/*
+ * lazy-q.hh
+ *
+ * Copyright 2018-2022 Franz Brauße <fb@paxle.org>
+ *
+ * See the LICENSE file for terms of distribution.
+ */
+
+#ifndef KAY_LAZY_Q_HH
+#define KAY_LAZY_Q_HH
+
+#include <cassert>
+#include <algorithm>	/* std::min, std::max */
+#include <ostream>
+
+#include <kay/numbers.hh>
+
+namespace kay {
+
+namespace lazy_detail {
+
+/* a /= b for b dividing a */
+inline void divexact(Z &a, const Z &b)
+{
+#if (KAY_USE_FLINT-0)
+	fmpz_divexact(a.get_fmpz_t(), a.get_fmpz_t(), b.get_fmpz_t());
+#else
+	mpz_divexact(a.get_mpz_t(), a.get_mpz_t(), b.get_mpz_t());
+#endif
+}
+
+/* r += a * b */
+inline void addmul(Z &r, const Z &a, const Z &b)
+{
+#if (KAY_USE_FLINT-0)
+	fmpz_addmul(r.get_fmpz_t(), a.get_fmpz_t(), b.get_fmpz_t());
+#else
+	mpz_addmul(r.get_mpz_t(), a.get_mpz_t(), b.get_mpz_t());
+#endif
+}
+
+inline bool is_one(const Z &a)
+{
+#if (KAY_USE_FLINT-0)
+	return fmpz_is_one(a.get_fmpz_t());
+#else
+	return !mpz_cmp_ui(a.get_mpz_t(), 1);
+#endif
+}
+
+}
+
+/* Rational accumulator for long chains of +=, -=, *= and /= whose
+ * intermediate results are not needed in lowest terms. Numerator and
+ * denominator are kept unreduced except for common factors of two, which are
+ * removed after each operation. The full gcd is computed when the denominator
+ * exceeds a bound, which then is set to twice its reduced size, at least
+ * reduce_bits, and when the value is read or compared.
+ *
+ * Reading a const lazy_Q canonicalizes it in place: concurrent reads of the
+ * same object need external synchronization. */
+class lazy_Q {
+
+	mutable Z num, den; /* den > 0 */
+	mutable bool canonical = true;
+	mp_bitcnt_t bound = reduce_bits;
+
+	void reduce() const
+	{
+		if (canonical)
+			return;
+		Z g = gcd(num, den);
+		if (!lazy_detail::is_one(g)) {
+			lazy_detail::divexact(num, g);
+			lazy_detail::divexact(den, g);
+		}
+		canonical = true;
+	}
+
+	/* restores the invariants after an update */
+	void normalize()
+	{
+		if (!sgn(num)) {
+			den = 1;
+			canonical = true;
+			return;
+		}
+		if (lazy_detail::is_one(den)) {
+			canonical = true;
+			return;
+		}
+		canonical = false;
+		mp_bitcnt_t z = std::min(ctz(num), ctz(den));
+		if (z) {
+			num >>= z;
+			den >>= z;
+		}
+		if (bits(den) > bound) {
+			reduce();
+			bound = std::max<mp_bitcnt_t>(reduce_bits, 2 * bits(den));
+		}
+	}
+
+	template <typename A>
+	void add(const Z &bn, const Z &bd, A addto)
+	{
+		if (den == bd)
+			addto(num, bn);
+		else if (lazy_detail::is_one(bd)) {
+			Z t = bn * den;
+			addto(num, t);
+		} else {
+			num *= bd;
+			addto(num, bn * den);
+			den *= bd;
+		}
+		normalize();
+	}
+
+	void mul(const Z &bn, const Z &bd)
+	{
+		num *= bn;
+		den *= bd;
+		normalize();
+	}
+
+	void div(const Z &bn, const Z &bd)
+	{
+		assert(sgn(bn));
+		num *= bd;
+		den *= bn;
+		if (sgn(den) < 0) {
+			neg(num);
+			neg(den);
+		}
+		normalize();
+	}
+
+	static void plus(Z &a, const Z &b) { a += b; }
+	static void minus(Z &a, const Z &b) { a -= b; }
+
+public:
+	/* smallest denominator size in bits triggering a gcd computation */
+	static constexpr mp_bitcnt_t reduce_bits = 256;
+
+	lazy_Q() : num(0), den(1) {}
+	lazy_Q(const Q &v) : num(v.get_num()), den(v.get_den()) {}
+	lazy_Q(const Z &v) : num(v), den(1) {}
+
+	lazy_Q & operator+=(const Q &b) { add(b.get_num(), b.get_den(), plus); return *this; }
+	lazy_Q & operator-=(const Q &b) { add(b.get_num(), b.get_den(), minus); return *this; }
+	lazy_Q & operator*=(const Q &b) { mul(b.get_num(), b.get_den()); return *this; }
+	lazy_Q & operator/=(const Q &b) { div(b.get_num(), b.get_den()); return *this; }
+
+	lazy_Q & operator+=(const lazy_Q &b) { add(b.num, b.den, plus); return *this; }
+	lazy_Q & operator-=(const lazy_Q &b) { add(b.num, b.den, minus); return *this; }
+	lazy_Q & operator*=(const lazy_Q &b) { mul(b.num, b.den); return *this; }
+	lazy_Q & operator/=(const lazy_Q &b)
+	{
+		if (this == &b) {
+			assert(sgn(num));
+			*this = lazy_Q(Z(1));
+		} else
+			div(b.num, b.den);
+		return *this;
+	}
+
+	/* *this += a * b without forming the product as a Q */
+	lazy_Q & addmul(const Q &a, const Q &b)
+	{
+		Z bd = a.get_den() * b.get_den();
+		if (den == bd)
+			lazy_detail::addmul(num, a.get_num(), b.get_num());
+		else {
+			num *= bd;
+			lazy_detail::addmul(num, a.get_num() * b.get_num(), den);
+			den *= bd;
+		}
+		normalize();
+		return *this;
+	}
+
+	/* reduces to lowest terms */
+	void canonicalize() const { reduce(); }
+
+	/* the value in lowest terms */
+	Q get() const
+	{
+		reduce();
+		Q r;
+		r.get_num() = num;
+		r.get_den() = den;
+		return r;
+	}
+
+	/* explicit: with implicit conversions both ways, comparisons of lazy_Q
+	 * and Q would be ambiguous */
+	explicit operator Q() const { return get(); }
+
+	/* the current, possibly unreduced, representation */
+	const Z & get_num() const { return num; }
+	const Z & get_den() const { return den; }
+
+	friend int sgn(const lazy_Q &a) { return sgn(a.num); }
+
+	friend bool operator==(const lazy_Q &a, const lazy_Q &b)
+	{
+		a.reduce();
+		b.reduce();
+		return a.num == b.num && a.den == b.den;
+	}
+
+	friend bool operator!=(const lazy_Q &a, const lazy_Q &b) { return !(a == b); }
+
+	friend int cmp(const lazy_Q &a, const lazy_Q &b)
+	{
+		a.reduce();
+		b.reduce();
+		int c = cmp(a.num * b.den, b.num * a.den);
+		return c < 0 ? -1 : c > 0 ? +1 : 0;
+	}
+
+	friend bool operator< (const lazy_Q &a, const lazy_Q &b) { return cmp(a, b) <  0; }
+	friend bool operator<=(const lazy_Q &a, const lazy_Q &b) { return cmp(a, b) <= 0; }
+	friend bool operator> (const lazy_Q &a, const lazy_Q &b) { return cmp(a, b) >  0; }
+	friend bool operator>=(const lazy_Q &a, const lazy_Q &b) { return cmp(a, b) >= 0; }
+
+	friend std::ostream & operator<<(std::ostream &os, const lazy_Q &a) { return os << a.get(); }
+};
+
+}
+
+#endif
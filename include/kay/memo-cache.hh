@@ -0,0 +1,328 @@
+/*
+ * memo-cache.hh
+ *
+ * Copyright 2018-2022 Franz Brauße <fb@paxle.org>
+ *
+ * See the LICENSE file for terms of distribution.
+ */
+
+#ifndef KAY_MEMO_CACHE_HH
+#define KAY_MEMO_CACHE_HH
+
+#include <atomic>
+#include <mutex>
+#include <thread>	/* std::thread::hardware_concurrency, std::this_thread::yield */
+#include <memory>	/* std::unique_ptr */
+#include <optional>
+#include <vector>
+#include <tuple>
+#include <algorithm>	/* std::max, std::min */
+
+#include <kay/flat-hash.hh>	/* kay::hasher, flat_detail::mix */
+
+namespace kay {
+
+namespace memo_detail {
+
+template <typename T, typename = void>
+struct has_identical : std::false_type {};
+template <typename T>
+struct has_identical<T,std::void_t<decltype(identical(std::declval<const T &>(),
+                                                      std::declval<const T &>()))>>
+: std::true_type {};
+
+template <typename T> bool same(const T &a, const T &b);
+template <typename T> bool same(const std::vector<T> &a, const std::vector<T> &b);
+template <typename... Ts> bool same(const std::tuple<Ts...> &a, const std::tuple<Ts...> &b);
+
+template <typename T> bool same(const T &a, const T &b)
+{
+	if constexpr (has_identical<T>::value)
+		return identical(a, b);
+	else
+		return a == b;
+}
+
+template <typename T> bool same(const std::vector<T> &a, const std::vector<T> &b)
+{
+	if (size(a) != size(b))
+		return false;
+	for (size_t i=0; i<size(a); i++)
+		if (!same(a[i], b[i]))
+			return false;
+	return true;
+}
+
+template <typename... Ts, size_t... is>
+bool same(const std::tuple<Ts...> &a, const std::tuple<Ts...> &b, std::index_sequence<is...>)
+{
+	return (same(std::get<is>(a), std::get<is>(b)) && ...);
+}
+
+template <typename... Ts> bool same(const std::tuple<Ts...> &a, const std::tuple<Ts...> &b)
+{
+	return same(a, b, std::index_sequence_for<Ts...>{});
+}
+
+}
+
+/* Key equality of memo_cache: values providing identical(a,b), like
+ * dbl::ival which has no operator==, are compared by it, others by ==;
+ * elementwise in tuples and vectors. */
+struct memo_equal {
+	template <typename T>
+	bool operator()(const T &a, const T &b) const { return memo_detail::same(a, b); }
+};
+
+struct memo_stats {
+	uint64_t hits, misses, insertions, evictions;
+
+	double hit_rate() const { return hits + misses ? (double)hits / (hits + misses) : 0; }
+};
+
+/* Bounded map from K to V for memoizing results of pure functions, e.g. from
+ * boxes std::vector<dbl::ival>, tuples of Q or tagged_idx nodes to interval or
+ * exact values, shared between threads.
+ *
+ * Entries live in buckets of 8 slots; the buckets are partitioned into shards,
+ * each with a mutex serializing its writers. Reads take no lock: they announce
+ * themselves in one of two counters of the shard, selected by the shard's
+ * epoch. An entry displaced by a writer is retired and deleted once the
+ * readers of the current epoch have left after the writer switched the epoch.
+ * A full bucket evicts by CLOCK: a hit sets the reference bit of its slot, the
+ * bucket's hand clears set bits and evicts the first slot found unset.
+ *
+ * find() returns copies of the values. Concurrent get_or_compute() calls for
+ * the same absent key may all compute it; the first result stored wins. */
+template <typename K, typename V, typename Hash = hasher<>, typename Eq = memo_equal>
+class memo_cache {
+
+	static constexpr size_t ways = 8;
+	static constexpr size_t retire_batch = 64;
+
+	struct node {
+		size_t h;
+		K key;
+		V val;
+	};
+
+	struct bucket {
+		std::atomic<node *> slot[ways];
+		std::atomic<uint8_t> ref[ways];
+		unsigned hand; /* guarded by the shard's mutex */
+	};
+
+	struct alignas(64) shard {
+		std::unique_ptr<bucket[]> b;
+		std::mutex m;
+		std::atomic<unsigned> epoch;
+		std::atomic<size_t> readers[2];
+		std::vector<node *> retired; /* guarded by m */
+		std::atomic<uint64_t> hits, misses, insertions, evictions;
+	};
+
+	class read_guard {
+		shard &s;
+		unsigned e;
+	public:
+		explicit read_guard(shard &s) : s(s)
+		{
+			for (;;) {
+				e = s.epoch.load();
+				s.readers[e].fetch_add(1);
+				if (s.epoch.load() == e)
+					break;
+				s.readers[e].fetch_sub(1);
+			}
+		}
+		~read_guard() { s.readers[e].fetch_sub(1, std::memory_order_release); }
+		read_guard(const read_guard &) = delete;
+		read_guard & operator=(const read_guard &) = delete;
+	};
+
+	std::unique_ptr<shard[]> shards;
+	size_t shard_bits, bucket_mask;
+	Hash hash;
+	Eq eq;
+
+	static size_t ceil_pow2(size_t n)
+	{
+		return n <= 1 ? 1 : (size_t)1 << (type_bits_v<size_t> - __builtin_clzll(n - 1));
+	}
+
+	size_t hash_of(const K &k) const { return flat_detail::mix(hash(k)); }
+
+	shard & shard_of(size_t h) const
+	{
+		return shards[shard_bits ? h >> (type_bits_v<size_t> - shard_bits) : 0];
+	}
+
+	bucket & bucket_of(shard &s, size_t h) const { return s.b[h & bucket_mask]; }
+
+	/* requires s.m to be held */
+	static void reclaim(shard &s)
+	{
+		unsigned e = s.epoch.load(std::memory_order_relaxed);
+		s.epoch.store(e ^ 1);
+		while (s.readers[e].load())
+			std::this_thread::yield();
+		for (node *p : s.retired)
+			delete p;
+		s.retired.clear();
+	}
+
+public:
+	/* Room for at least capacity entries, rounded up to a power of two. The
+	 * default number of shards is 4 per hardware thread. */
+	explicit memo_cache(size_t capacity, size_t n_shards = 0)
+	{
+		size_t nb = ceil_pow2((capacity + ways - 1) / ways);
+		if (!n_shards)
+			n_shards = 4 * std::max(std::thread::hardware_concurrency(), 1U);
+		n_shards = std::min(ceil_pow2(n_shards), nb);
+		shard_bits = __builtin_ctzll(n_shards);
+		bucket_mask = nb / n_shards - 1;
+		shards.reset(new shard[n_shards]);
+		for (size_t i=0; i<n_shards; i++) {
+			shard &s = shards[i];
+			s.b.reset(new bucket[bucket_mask + 1]);
+			for (size_t j=0; j<=bucket_mask; j++) {
+				for (size_t k=0; k<ways; k++) {
+					s.b[j].slot[k].store(nullptr, std::memory_order_relaxed);
+					s.b[j].ref[k].store(0, std::memory_order_relaxed);
+				}
+				s.b[j].hand = 0;
+			}
+			s.epoch.store(0, std::memory_order_relaxed);
+			s.readers[0].store(0, std::memory_order_relaxed);
+			s.readers[1].store(0, std::memory_order_relaxed);
+		}
+		reset_stats();
+	}
+
+	memo_cache(const memo_cache &) = delete;
+	memo_cache & operator=(const memo_cache &) = delete;
+
+	~memo_cache()
+	{
+		for (size_t i=0; i<n_shards(); i++) {
+			shard &s = shards[i];
+			for (node *p : s.retired)
+				delete p;
+			for (size_t j=0; j<=bucket_mask; j++)
+				for (size_t k=0; k<ways; k++)
+					delete s.b[j].slot[k].load(std::memory_order_relaxed);
+		}
+	}
+
+	size_t n_shards() const { return (size_t)1 << shard_bits; }
+	size_t capacity() const { return n_shards() * (bucket_mask + 1) * ways; }
+
+	/* the value stored for k, if any */
+	std::optional<V> find(const K &k) const
+	{
+		size_t h = hash_of(k);
+		shard &s = shard_of(h);
+		bucket &b = bucket_of(s, h);
+		read_guard g(s);
+		for (size_t i=0; i<ways; i++) {
+			const node *p = b.slot[i].load(std::memory_order_acquire);
+			if (p && p->h == h && eq(p->key, k)) {
+				if (!b.ref[i].load(std::memory_order_relaxed))
+					b.ref[i].store(1, std::memory_order_relaxed);
+				s.hits.fetch_add(1, std::memory_order_relaxed);
+				return p->val;
+			}
+		}
+		s.misses.fetch_add(1, std::memory_order_relaxed);
+		return std::nullopt;
+	}
+
+	/* stores v for k unless k is present; returns whether it was stored */
+	bool insert(const K &k, V v)
+	{
+		size_t h = hash_of(k);
+		shard &s = shard_of(h);
+		bucket &b = bucket_of(s, h);
+		std::unique_ptr<node> n(new node { h, k, std::move(v) });
+		std::lock_guard<std::mutex> lock(s.m);
+		size_t w = ways;
+		for (size_t i=0; i<ways; i++) {
+			const node *p = b.slot[i].load(std::memory_order_relaxed);
+			if (!p) {
+				if (w == ways)
+					w = i;
+			} else if (p->h == h && eq(p->key, k))
+				return false;
+		}
+		if (w == ways) {
+			for (;; b.hand = (b.hand + 1) % ways)
+				if (!b.ref[b.hand].exchange(0, std::memory_order_relaxed))
+					break;
+			w = b.hand;
+			b.hand = (b.hand + 1) % ways;
+			s.retired.push_back(b.slot[w].load(std::memory_order_relaxed));
+			s.evictions.fetch_add(1, std::memory_order_relaxed);
+		}
+		b.ref[w].store(0, std::memory_order_relaxed);
+		b.slot[w].store(n.release(), std::memory_order_release);
+		s.insertions.fetch_add(1, std::memory_order_relaxed);
+		if (s.retired.size() >= retire_batch)
+			reclaim(s);
+		return true;
+	}
+
+	/* the value stored for k, or f() which is then stored */
+	template <typename F>
+	V get_or_compute(const K &k, F &&f)
+	{
+		if (std::optional<V> r = find(k))
+			return std::move(*r);
+		V v = std::forward<F>(f)();
+		insert(k, v);
+		return v;
+	}
+
+	/* not to be called concurrently with the destructor */
+	void clear()
+	{
+		for (size_t i=0; i<n_shards(); i++) {
+			shard &s = shards[i];
+			std::lock_guard<std::mutex> lock(s.m);
+			for (size_t j=0; j<=bucket_mask; j++)
+				for (size_t k=0; k<ways; k++)
+					if (node *p = s.b[j].slot[k].exchange(nullptr, std::memory_order_relaxed))
+						s.retired.push_back(p);
+			reclaim(s);
+		}
+	}
+
+	/* counters summed over the shards, each read atomically */
+	memo_stats stats() const
+	{
+		memo_stats r {};
+		for (size_t i=0; i<n_shards(); i++) {
+			const shard &s = shards[i];
+			r.hits       += s.hits.load(std::memory_order_relaxed);
+			r.misses     += s.misses.load(std::memory_order_relaxed);
+			r.insertions += s.insertions.load(std::memory_order_relaxed);
+			r.evictions  += s.evictions.load(std::memory_order_relaxed);
+		}
+		return r;
+	}
+
+	void reset_stats()
+	{
+		for (size_t i=0; i<n_shards(); i++) {
+			shard &s = shards[i];
+			s.hits.store(0, std::memory_order_relaxed);
+			s.misses.store(0, std::memory_order_relaxed);
+			s.insertions.store(0, std::memory_order_relaxed);
+			s.evictions.store(0, std::memory_order_relaxed);
+		}
+	}
+};
+
+}
+
+#endif
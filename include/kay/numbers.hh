@@ -21,11 +21,13 @@
 
 #include <charconv>	/* std::from_chars_result */
 #include <cassert>
+#include <functional>	/* std::hash */
 
 #include <kay/bits.hh>
 #include <kay/gmpxx.hh>
 #include <kay/flintxx.hh>
 #include <kay/compiletime.hh>
+#include <kay/instrument.hh>
 
 #if !defined(KAY_USE_FLINT) && !defined(KAY_USE_GMPXX)
 # if KAY_HAVE_FLINT
@@ -89,6 +91,7 @@ inline mp_bitcnt_t sizeinbase(const Z &a, int base)
 inline void canonicalize(Q &v)
 {
 	v.canonicalize();
+	instrument::count(instrument::canonicalize);
 }
 
 inline const mpz_class & to_mpz_class(const Z &z) { return z; }
@@ -114,6 +117,7 @@ namespace kay {
 /* parses stuff like "0.85" */
 static inline Q Q_from_str(char *rep, unsigned base = 10)
 {
+	instrument::count(instrument::parse);
 	const char *elit = base == 10 ? "eE" : base == 16 ? "p" : nullptr;
 	char *e = rep + (elit ? strcspn(rep, elit) : 0);
 	if (*e)
@@ -140,9 +144,11 @@ static inline Q Q_from_str(char *rep, unsigned base = 10)
 	return r;
 }
 
+namespace detail {
+
 inline std::from_chars_result
-from_chars(const char *rep, const char *end, Z &v, int base = 0,
-           bool incl_sign = true, bool incl_prefix = true)
+from_chars_Z(const char *rep, const char *end, Z &v, int base,
+             bool incl_sign, bool incl_prefix)
 {
 	assert(!base || base > 1);
 	assert(!base || base < 36);
@@ -197,6 +203,16 @@ from_chars(const char *rep, const char *end, Z &v, int base = 0,
 	return { st, std::errc {} };
 }
 
+} /* namespace detail */
+
+inline std::from_chars_result
+from_chars(const char *rep, const char *end, Z &v, int base = 0,
+           bool incl_sign = true, bool incl_prefix = true)
+{
+	instrument::count(instrument::parse);
+	return detail::from_chars_Z(rep, end, v, base, incl_sign, incl_prefix);
+}
+
 namespace detail {
 
 inline std::from_chars_result
@@ -207,7 +223,7 @@ from_chars_Q_component(const char *rep, const char *end, Q &v, int base)
 	if (strchr("+-", *rep))
 		rep++;
 	v = 0;
-	auto [ze,zr] = from_chars(rep, end, v.get_num(), base, true, false);
+	auto [ze,zr] = from_chars_Z(rep, end, v.get_num(), base, true, false);
 	if (zr != std::errc {})
 		return { beg, zr };
 	if (ze == end) {
@@ -219,7 +235,7 @@ from_chars_Q_component(const char *rep, const char *end, Q &v, int base)
 	const char *st = ze;
 	if (*st == '.' && isdigit(st[1])) {
 		Z f;
-		auto [fe,fr] = from_chars(st + 1, end, f, base, false, false);
+		auto [fe,fr] = from_chars_Z(st + 1, end, f, base, false, false);
 		if (fr != std::errc {}) {
 			end = st;
 		} else {
@@ -252,6 +268,7 @@ from_chars_Q_component(const char *rep, const char *end, Q &v, int base)
 inline std::from_chars_result
 from_chars(const char *rep, const char *end, Q &v, int base = 10)
 {
+	instrument::count(instrument::parse);
 	auto r = detail::from_chars_Q_component(rep, end, v, base);
 	if (r.ec != std::errc {})
 		return { rep, r.ec };
@@ -279,6 +296,14 @@ inline Q scale(Q v, ssize_t n)
 	return v;
 }
 
+/* types hashed by std::hash in kay::do_hash: those with an enabled
+ * specialization, including Z and Q */
+template <typename T> struct hash_std_kay
+: std::disjunction<hash_std_default<T>,
+                   std::is_default_constructible<std::hash<std::remove_cv_t<T>>>>
+{};
+
+static_assert(hash_std_kay<Z>::value && hash_std_kay<Q>::value);
 
 namespace integral_literal_support {
 
@@ -379,13 +404,217 @@ static_assert(sizeof(size_t) != 4 || parse_v<'4','2','9','4','9','6','7','2','9'
 static_assert(sizeof(size_t) > 8 || parse_v<'1','8','4','4','6','7','4','4','0','7','3','7','0','9','5','5','1','6','1','6'> == 0);
 
 
+/* Constant-expression parser for the characters of raw literals. Digit
+ * separators are skipped, invalid digits are a compile-time error. */
+
+using compiletime::nat;
+
+constexpr unsigned digit_value(char c, unsigned base)
+{
+	unsigned d = '0' <= c && c <= '9' ? c - '0'
+	           : 'a' <= c && c <= 'f' ? c - 'a' + 10
+	           : 'A' <= c && c <= 'F' ? c - 'A' + 10
+	           : base;
+	if (d >= base)
+		throw std::invalid_argument("invalid digit in literal");
+	return d;
+}
+
+template <size_t K>
+constexpr nat<K> parse_digits(const char *s, size_t n, unsigned base)
+{
+	nat<K> r;
+	for (size_t i=0; i < n; i++)
+		if (s[i] != '\'')
+			r = r * base + nat<K>(digit_value(s[i], base));
+	return r;
+}
+
+constexpr unsigned literal_base(const char *s, size_t n, size_t &i)
+{
+	i = 0;
+	if (n > 1 && s[0] == '0') {
+		if (s[1] == 'x' || s[1] == 'X')
+			return i = 2, 16;
+		if (s[1] == 'b' || s[1] == 'B')
+			return i = 2, 2;
+		return i = 1, 8;
+	}
+	return 10;
+}
+
+/* capacity in limbs sufficient for any integer literal of n characters */
+constexpr size_t literal_limbs(size_t n) { return (4 * n + 63) / 64 + 1; }
+
+template <size_t K>
+constexpr nat<K> parse_integer(const char *s, size_t n)
+{
+	size_t i = 0;
+	unsigned base = literal_base(s, n, i);
+	return parse_digits<K>(s + i, n - i, base);
+}
+
+/* Limbs of a natural number as static read-only data for GMP. */
+template <typename V>
+struct mp_limbs {
+	static_assert(GMP_LIMB_BITS == 64 && GMP_NAIL_BITS == 0,
+	              "only 64-bit limbs are supported");
+
+	template <size_t... is>
+	static constexpr std::array<mp_limb_t,sizeof...(is)>
+	get(std::index_sequence<is...>) { return { V::value[is]... }; }
+
+	static constexpr auto limbs = get(std::make_index_sequence<V::value.size()>{});
+};
+
+template <typename V>
+inline Z Z_from_limbs()
+{
+	constexpr auto &l = mp_limbs<V>::limbs;
+	mpz_t v;
+	return Z(mpz_roinit_n(v, l.data(), l.size()));
+}
+
 template <char... cs>
-constexpr std::enable_if_t<fits_v<unsigned long,cs...>,Z> parse_Z()
-{ return parse_v<cs...>; }
+struct integer_literal {
+	static constexpr char s[] = { cs... };
+	static constexpr nat<literal_limbs(sizeof...(cs))> value =
+		parse_integer<literal_limbs(sizeof...(cs))>(s, sizeof...(cs));
+};
 
+/* Literals fitting into unsigned long are constructed directly, larger ones
+ * are built once from their limbs computed at compile time and then copied. */
 template <char... cs>
-inline std::enable_if_t<!fits_v<unsigned long,cs...>,Z> parse_Z()
-{ char str[] = {cs...,'\0'}; return Z(str); }
+inline Z parse_Z()
+{
+	using V = integer_literal<cs...>;
+	if constexpr (bits(V::value) <= std::numeric_limits<unsigned long>::digits) {
+		return Z(static_cast<unsigned long>(V::value[0]));
+	} else {
+		static const Z z = Z_from_limbs<V>();
+		return z;
+	}
+}
+
+/* Exact value num/den of a floating or integer literal in lowest terms. The
+ * value of a decimal literal is m * 10^(exp-frac), that of a hexadecimal
+ * floating literal m * 2^(exp-4*frac) where m are the digits without the
+ * point and frac is the number of digits after it. */
+struct rational_literal_info {
+	unsigned base;   /* of the digits */
+	size_t start;    /* index of the first digit */
+	size_t frac;     /* number of digits after the point */
+	long exp;        /* decimal exponent for base 10, otherwise binary */
+	size_t limbs;    /* sufficient capacity */
+};
+
+constexpr bool is_exponent_char(char c, unsigned base)
+{
+	return base == 16 ? c == 'p' || c == 'P' : c == 'e' || c == 'E';
+}
+
+constexpr long parse_exponent(const char *s, size_t n)
+{
+	bool neg = n && s[0] == '-';
+	size_t i = n && (s[0] == '-' || s[0] == '+');
+	if (i == n)
+		throw std::invalid_argument("empty exponent in literal");
+	long e = 0;
+	for (; i < n; i++)
+		if (s[i] != '\'') {
+			e = 10 * e + digit_value(s[i], 10);
+			if (e > (1L << 24))
+				throw std::overflow_error("exponent of literal too large");
+		}
+	return neg ? -e : e;
+}
+
+constexpr rational_literal_info scan_rational(const char *s, size_t n)
+{
+	rational_literal_info r = {};
+	r.base = literal_base(s, n, r.start);
+	if (r.base != 16)
+		for (size_t j=0; j < n; j++)
+			if (s[j] == '.' || is_exponent_char(s[j], 10)) {
+				/* leading zeros of floating literals do not denote
+				 * octal */
+				r.base = 10;
+				r.start = 0;
+			}
+	size_t j = r.start;
+	while (j < n && s[j] != '.' && !is_exponent_char(s[j], r.base))
+		j++;
+	if (j < n && s[j] == '.')
+		for (j++; j < n && !is_exponent_char(s[j], r.base); j++)
+			r.frac += s[j] != '\'';
+	if (j < n)
+		r.exp = parse_exponent(s + j + 1, n - j - 1);
+	unsigned long e = r.exp < 0 ? -r.exp : r.exp;
+	r.limbs = literal_limbs(n) + ((r.base == 10 ? 4 : 1) * e + 4 * r.frac) / 64 + 1;
+	return r;
+}
+
+template <size_t K>
+struct rational_value { nat<K> num, den; };
+
+template <size_t K>
+constexpr rational_value<K> parse_rational(const char *s, size_t n,
+                                           const rational_literal_info &info)
+{
+	nat<K> num, den = 1;
+	for (size_t i = info.start; i < n && !is_exponent_char(s[i], info.base); i++)
+		if (s[i] != '\'' && s[i] != '.')
+			num = num * info.base + nat<K>(digit_value(s[i], info.base));
+	if (!num)
+		return { num, den };
+	if (info.base == 10) {
+		long e = info.exp - (long)info.frac;
+		if (e >= 0)
+			num *= pow(nat<K>(10), e);
+		else
+			den = pow(nat<K>(10), -e);
+		nat<K> g = gcd(num, den);
+		num /= g;
+		den /= g;
+	} else {
+		long e = info.exp - (info.base == 16 ? 4 * (long)info.frac : 0);
+		size_t z = ctz(num);
+		if (e >= 0)
+			num <<= e;
+		else if ((size_t)-e <= z)
+			num >>= -e;
+		else {
+			num >>= z;
+			den <<= -e - z;
+		}
+	}
+	return { num, den };
+}
+
+template <char... cs>
+struct rational_literal {
+	static constexpr char s[] = { cs... };
+	static constexpr rational_literal_info info = scan_rational(s, sizeof...(cs));
+	static constexpr rational_value<info.limbs> value =
+		parse_rational<info.limbs>(s, sizeof...(cs), info);
+
+	struct num { static constexpr auto &value = rational_literal::value.num; };
+	struct den { static constexpr auto &value = rational_literal::value.den; };
+};
+
+/* The value is in lowest terms already and is not canonicalized again. */
+template <char... cs>
+inline const Q & parse_Q()
+{
+	using V = rational_literal<cs...>;
+	static const Q q = [] {
+		Q r;
+		r.get_num() = Z_from_limbs<typename V::num>();
+		r.get_den() = Z_from_limbs<typename V::den>();
+		return r;
+	}();
+	return q;
+}
 
 };
 
@@ -394,6 +623,12 @@ namespace literals {
 template <char... cs>
 inline Z operator""_Z() { return integral_literal_support::parse_Z<cs...>(); }
 
+/* exact rational value of integer or floating literals, e.g., 0.125_Q is 1/8,
+ * 1e-3_Q is 1/1000 and 0x1.8p-1_Q is 3/4; refers to a static object valid
+ * until the end of the program */
+template <char... cs>
+inline const Q & operator""_Q() { return integral_literal_support::parse_Q<cs...>(); }
+
 }
 
 }
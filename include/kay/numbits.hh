@@ -10,7 +10,15 @@
 #ifndef KAY_NUM_BITS_HH
 #define KAY_NUM_BITS_HH
 
+#include <cstring>	/* memcpy */
+#include <cmath>	/* std::fpclassify */
+#include <cfloat>	/* DBL_MANT_DIG */
+#include <limits>
+#include <algorithm>	/* std::max */
+#include <cassert>
+
 #include <kay/numbers.hh>
+#include <kay/dispatch.hh>
 
 namespace kay {
 
@@ -44,6 +52,21 @@ template <typename T> struct fund_type_bit_cnt<T,true,true> {
 
 	size_t operator()(T v) const
 	{
+		if constexpr (std::numeric_limits<T>::is_iec559 &&
+		              (sizeof(T) == sizeof(uint32_t) || sizeof(T) == sizeof(uint64_t))) {
+			/* the significand, including the implicit bit of normal
+			 * numbers, from the representation */
+			using U = std::conditional_t<sizeof(T) == sizeof(uint32_t),uint32_t,uint64_t>;
+			constexpr int M = std::numeric_limits<T>::digits - 1;
+			constexpr U emask = ((U)1 << (type_bits_v<U> - 1 - M)) - 1;
+			U x, e, m;
+			memcpy(&x, &v, sizeof(x));
+			e = x >> M & emask;
+			m = x & (((U)1 << M) - 1);
+			if (e == emask)
+				return 0;
+			return flt_prec(e ? m | (U)1 << M : m);
+		}
 		int exp;
 		switch (std::fpclassify(v)) {
 		case FP_NAN:
@@ -100,7 +123,7 @@ template <typename T> struct fund_type_bit_cnt<T,false,true> {
 	{
 		if constexpr (is_twos_complement)
 			if (v == std::numeric_limits<T>::min())
-				return type_bits_v<T>;
+				return 1;
 		return flt_prec(static_cast<std::make_unsigned_t<T>>(std::abs(v)));
 	}
 
@@ -118,14 +141,397 @@ private:
 };
 }
 
+namespace detail {
+
+/* significant bits of |v|, directly from the limbs */
+inline size_t mpz_prec(mpz_srcptr v)
+{
+	size_t n = v->_mp_size < 0 ? -(size_t)v->_mp_size : v->_mp_size;
+	if (!n)
+		return 0;
+	const mp_limb_t *d = v->_mp_d;
+	size_t i = 0;
+	while (!d[i])
+		i++;
+	return (n - i) * GMP_NUMB_BITS - type_u_ul_ull_bits0<mp_limb_t>::clz(d[n-1])
+	                               - type_u_ul_ull_bits0<mp_limb_t>::ctz(d[i]);
+}
+
+}
+
 template <> struct type_bit_cnt<Z> {
 
 	size_t operator()(const Z &v) const
 	{
-		return v ? bits(v) - ctz(v) : 0;
+#if (KAY_USE_FLINT-0)
+		fmpz f = *v.get_fmpz_t();
+		if (!COEFF_IS_MPZ(f))
+			return flt_prec(static_cast<slong>(f));
+		return detail::mpz_prec(COEFF_TO_PTR(f));
+#else
+		return detail::mpz_prec(v.get_mpz_t());
+#endif
+	}
+};
+
+/* SIZE_MAX for non-dyadic rationals, which no binary floating-point format
+ * represents */
+template <> struct type_bit_cnt<Q> {
+
+	size_t operator()(const Q &v) const
+	{
+		return flt_prec(v.get_den()) > 1 ? SIZE_MAX : flt_prec(v.get_num());
 	}
 };
 
+/* whether v converts to double without rounding */
+inline bool is_exact_double(const Z &v)
+{
+	return flt_prec(v) <= DBL_MANT_DIG && bits(v) <= DBL_MAX_EXP;
+}
+
+inline bool is_exact_double(const Q &v)
+{
+	const Z &num = v.get_num(), &den = v.get_den();
+	if (flt_prec(den) > 1)
+		return false;
+	if (!sgn(num))
+		return true;
+	/* v = num * 2^-k, num is odd if k > 0 */
+	long k = bits(den) - 1;
+	long hi = (long)bits(num) - 1 - k;
+	long lo = (long)ctz(num) - k;
+	return hi - lo < DBL_MANT_DIG && hi < DBL_MAX_EXP &&
+	       lo >= DBL_MIN_EXP - DBL_MANT_DIG;
+}
+
+namespace detail {
+
+#if (KAY_USE_FLINT-0)
+/* v as an mpz, which for small values refers to the limb l */
+inline mpz_srcptr mpz_of(const fmpz &v, __mpz_struct &tmp, mp_limb_t &l)
+{
+	if (COEFF_IS_MPZ(v))
+		return COEFF_TO_PTR(v);
+	l = v < 0 ? -(mp_limb_t)v : v;
+	tmp._mp_alloc = 0;
+	tmp._mp_size = v < 0 ? -1 : v > 0;
+	tmp._mp_d = &l;
+	return &tmp;
+}
+#endif
+
+/* the leading 64 bits t of v != 0 with v in [t, t+1) * 2^s, exact if v is
+ * known to equal t * 2^s */
+struct top64 {
+	uint64_t t;
+	long s;
+	bool exact;
+};
+
+inline top64 mpz_top64(mpz_srcptr v)
+{
+	static_assert(GMP_NUMB_BITS == 64);
+	size_t n = v->_mp_size < 0 ? -(size_t)v->_mp_size : v->_mp_size;
+	const mp_limb_t *d = v->_mp_d;
+	if (n == 1)
+		return { d[0], 0, true };
+	unsigned c = __builtin_clzll(d[n-1]);
+	uint64_t t = c ? d[n-1] << c | d[n-2] >> (64 - c) : d[n-1];
+	return { t, (long)(n - 1) * 64 - c, false };
+}
+
+inline long bits128(unsigned __int128 v)
+{
+	uint64_t h = v >> 64;
+	return h ? 128 - __builtin_clzll(h) : 64 - __builtin_clzll((uint64_t)v);
+}
+
+/* sign of x * 2^ex - y * 2^ey for x, y != 0 */
+inline int cmp_scaled(unsigned __int128 x, long ex, unsigned __int128 y, long ey)
+{
+	long bx = bits128(x) + ex, by = bits128(y) + ey;
+	if (bx != by)
+		return bx < by ? -1 : +1;
+	/* the shifted value has the bit length of the other one */
+	if (ex > ey)
+		x <<= ex - ey;
+	else
+		y <<= ey - ex;
+	return x < y ? -1 : x > y ? +1 : 0;
+}
+
+/* Sign of |num| - m * 2^e * den for den > 0, or den = 1 if null, and num, m
+ * != 0. The bit lengths or the leading 64 bits of num and den decide unless
+ * the values are closer than about 2^-60 relative to each other. */
+inline int cmpabs_scaled(mpz_srcptr num, mpz_srcptr den, uint64_t m, long e)
+{
+	long bn = mpz_sizeinbase(num, 2);
+	long bd = den ? mpz_sizeinbase(den, 2) : 1;
+	/* |num| is in [2^(bn-1), 2^bn), the right side in [2^(l-2), 2^l) */
+	long l = 64 - __builtin_clzll(m) + bd + e;
+	if (bn > l)
+		return +1;
+	if (bn <= l - 2)
+		return -1;
+	top64 a = mpz_top64(num);
+	top64 b = den ? mpz_top64(den) : top64 { 1, 0, true };
+	using u128 = unsigned __int128;
+	if (cmp_scaled((u128)a.t + !a.exact, a.s, (u128)m * b.t, b.s + e) < 0)
+		return -1;
+	if (cmp_scaled(a.t, a.s, (u128)m * ((u128)b.t + !b.exact), b.s + e) > 0)
+		return +1;
+	if (a.exact && b.exact)
+		return 0;
+	/* near-tie: cross-multiply exactly */
+	mpz_t l2, r;
+	mpz_init(l2);
+	mpz_init(r);
+	mpz_abs(l2, num);
+	if (den)
+		mpz_mul_ui(r, den, m);
+	else
+		mpz_set_ui(r, m);
+	if (e >= 0)
+		mpz_mul_2exp(r, r, e);
+	else
+		mpz_mul_2exp(l2, l2, -e);
+	int c = mpz_cmp(l2, r);
+	mpz_clear(l2);
+	mpz_clear(r);
+	return c < 0 ? -1 : c > 0 ? +1 : 0;
+}
+
+/* sign of num/den - d, or of num - d if den is null; d must not be NaN */
+inline int cmp_mpq_d(mpz_srcptr num, mpz_srcptr den, double d)
+{
+	assert(!std::isnan(d));
+	int sn = mpz_sgn(num), sd = (d > 0) - (d < 0);
+	if (sn != sd)
+		return sn < sd ? -1 : +1;
+	if (!sn)
+		return 0;
+	if (std::isinf(d))
+		return -sd;
+	/* |d| = m * 2^e */
+	static_assert(std::numeric_limits<double>::is_iec559);
+	uint64_t x;
+	memcpy(&x, &d, sizeof(x));
+	uint64_t be = x >> 52 & 0x7ff;
+	uint64_t m = x & (((uint64_t)1 << 52) - 1);
+	long e = -1074;
+	if (be) {
+		m |= (uint64_t)1 << 52;
+		e = (long)be - 1075;
+	}
+	int c = cmpabs_scaled(num, den, m, e);
+	return sn > 0 ? c : -c;
+}
+
+}
+
+/* Comparisons with doubles, which must not be NaN, without converting either
+ * operand. For Q, the bit lengths and leading limbs decide all but near-ties,
+ * which are resolved by exact cross-multiplication. */
+
+inline int cmp(const Z &a, double b)
+{
+#if (KAY_USE_FLINT-0)
+	__mpz_struct t;
+	mp_limb_t l;
+	int c = mpz_cmp_d(detail::mpz_of(*a.get_fmpz_t(), t, l), b);
+#else
+	int c = mpz_cmp_d(a.get_mpz_t(), b);
+#endif
+	return c < 0 ? -1 : c > 0 ? +1 : 0;
+}
+
+inline int cmp(const Q &a, double b)
+{
+#if (KAY_USE_FLINT-0)
+	__mpz_struct tn, td;
+	mp_limb_t ln, ld;
+	const fmpq *q = a.get_fmpq_t();
+	return detail::cmp_mpq_d(detail::mpz_of(q->num, tn, ln),
+	                         detail::mpz_of(q->den, td, ld), b);
+#else
+	return detail::cmp_mpq_d(a.get_num_mpz_t(), a.get_den_mpz_t(), b);
+#endif
+}
+
+#if (KAY_USE_FLINT-0)
+/* Exact comparisons with integers: without them, the standard conversion of
+ * an integer to double would select the overloads above over cmp(Z,Z) and
+ * cmp(Q,Q). gmpxx provides these itself. */
+template <typename I, typename = std::enable_if_t<std::is_integral_v<I> &&
+                                                  sizeof(I) <= sizeof(long)>>
+inline int cmp(const Z &a, I b)
+{
+	int c;
+	if constexpr (std::is_signed_v<I>)
+		c = fmpz_cmp_si(a.get_fmpz_t(), b);
+	else
+		c = fmpz_cmp_ui(a.get_fmpz_t(), b);
+	return c < 0 ? -1 : c > 0 ? +1 : 0;
+}
+
+template <typename I, typename = std::enable_if_t<std::is_integral_v<I> &&
+                                                  sizeof(I) <= sizeof(long)>>
+inline int cmp(const Q &a, I b)
+{
+	if (fmpz_is_one(a.get_den().get_fmpz_t()))
+		return cmp(a.get_num(), b);
+	using L = std::conditional_t<std::is_signed_v<I>,signed long,unsigned long>;
+	return cmp(a.get_num(), a.get_den() * Z(static_cast<L>(b)));
+}
+
+/* found by argument-dependent lookup as the other operations on Z and Q */
+namespace flintxx { using kay::cmp; }
+#endif
+
+namespace detail {
+
+/* number of bits from the highest to the lowest set bit of x, 0 for x = 0;
+ * the or-ed bits do not change the counts for x != 0 and make them defined
+ * for x = 0 */
+inline uint64_t bit_span(uint64_t x)
+{
+	uint64_t r = 64 - __builtin_clzll(x | 1) - __builtin_ctzll(x | (uint64_t)1 << 63);
+	return r & -(uint64_t)(x != 0);
+}
+
+inline uint64_t dbl_prec(double v)
+{
+	static_assert(std::numeric_limits<double>::is_iec559);
+	uint64_t x;
+	memcpy(&x, &v, sizeof(x));
+	uint64_t e = x >> 52 & 0x7ff;
+	uint64_t m = x & (((uint64_t)1 << 52) - 1);
+	uint64_t r = bit_span(e ? m | (uint64_t)1 << 52 : m);
+	return r & -(uint64_t)(e != 0x7ff);
+}
+
+template <typename T>
+inline uint64_t int_prec(T v)
+{
+	static_assert(sizeof(T) <= sizeof(uint64_t));
+	uint64_t u = v;
+	if constexpr (std::is_signed_v<T>)
+		u = v < 0 ? -u : u;
+	return bit_span(u);
+}
+
+}
+
+namespace detail {
+
+KAY_KERNEL void flt_prec(const double *v, size_t n, size_t *prec)
+{
+	for (size_t i=0; i<n; i++)
+		prec[i] = dbl_prec(v[i]);
+}
+
+template <typename T>
+KAY_KERNEL void flt_prec(const T *v, size_t n, size_t *prec)
+{
+	for (size_t i=0; i<n; i++)
+		prec[i] = int_prec(v[i]);
+}
+
+/* precisions fit 32 bits, whose maximum has vector instructions */
+KAY_KERNEL size_t max_flt_prec(const double *v, size_t n)
+{
+	uint32_t r = 0;
+	for (size_t i=0; i<n; i++)
+		r = std::max(r, (uint32_t)dbl_prec(v[i]));
+	return r;
+}
+
+template <typename T>
+KAY_KERNEL size_t max_flt_prec(const T *v, size_t n)
+{
+	uint32_t r = 0;
+	for (size_t i=0; i<n; i++)
+		r = std::max(r, (uint32_t)int_prec(v[i]));
+	return r;
+}
+
+KAY_KERNEL void flt_prec_d(const double *v, size_t n, size_t *prec) { flt_prec(v, n, prec); }
+KAY_KERNEL void flt_prec_s64(const int64_t *v, size_t n, size_t *prec) { flt_prec(v, n, prec); }
+KAY_KERNEL void flt_prec_u64(const uint64_t *v, size_t n, size_t *prec) { flt_prec(v, n, prec); }
+KAY_KERNEL size_t max_flt_prec_d(const double *v, size_t n) { return max_flt_prec(v, n); }
+KAY_KERNEL size_t max_flt_prec_s64(const int64_t *v, size_t n) { return max_flt_prec(v, n); }
+KAY_KERNEL size_t max_flt_prec_u64(const uint64_t *v, size_t n) { return max_flt_prec(v, n); }
+
+KAY_MULTIVERSION(flt_prec_d, void, (const double *v, size_t n, size_t *prec), (v, n, prec))
+KAY_MULTIVERSION(flt_prec_s64, void, (const int64_t *v, size_t n, size_t *prec), (v, n, prec))
+KAY_MULTIVERSION(flt_prec_u64, void, (const uint64_t *v, size_t n, size_t *prec), (v, n, prec))
+KAY_MULTIVERSION(max_flt_prec_d, size_t, (const double *v, size_t n), (v, n))
+KAY_MULTIVERSION(max_flt_prec_s64, size_t, (const int64_t *v, size_t n), (v, n))
+KAY_MULTIVERSION(max_flt_prec_u64, size_t, (const uint64_t *v, size_t n), (v, n))
+
+/* arrays shorter than this are processed inline */
+constexpr size_t batch_dispatch_min = 64;
+
+}
+
+/* Batch versions operating on arrays. The loops are free of branches; the
+ * counts of leading and trailing zeros compile to lzcnt/tzcnt, or to vector
+ * instructions where the target has them. Arrays of double, int64_t or uint64_t
+ * of at least 64 elements are processed by the variant for selected_isa(). */
+
+inline void flt_prec(const double *v, size_t n, size_t *prec)
+{
+	if (n < detail::batch_dispatch_min)
+		return detail::flt_prec(v, n, prec);
+	static const auto f = detail::flt_prec_d_isa::select();
+	f(v, n, prec);
+}
+
+template <typename T>
+inline std::enable_if_t<std::is_integral_v<T>> flt_prec(const T *v, size_t n, size_t *prec)
+{
+	if constexpr (std::is_same_v<T,int64_t>) {
+		if (n >= detail::batch_dispatch_min) {
+			static const auto f = detail::flt_prec_s64_isa::select();
+			return f(v, n, prec);
+		}
+	} else if constexpr (std::is_same_v<T,uint64_t>) {
+		if (n >= detail::batch_dispatch_min) {
+			static const auto f = detail::flt_prec_u64_isa::select();
+			return f(v, n, prec);
+		}
+	}
+	detail::flt_prec(v, n, prec);
+}
+
+/* maximum of flt_prec() over v[0,n), e.g. to check that all values are exact
+ * doubles by max_flt_prec(v, n) <= DBL_MANT_DIG */
+inline size_t max_flt_prec(const double *v, size_t n)
+{
+	if (n < detail::batch_dispatch_min)
+		return detail::max_flt_prec(v, n);
+	static const auto f = detail::max_flt_prec_d_isa::select();
+	return f(v, n);
+}
+
+template <typename T>
+inline std::enable_if_t<std::is_integral_v<T>,size_t> max_flt_prec(const T *v, size_t n)
+{
+	if constexpr (std::is_same_v<T,int64_t>) {
+		if (n >= detail::batch_dispatch_min) {
+			static const auto f = detail::max_flt_prec_s64_isa::select();
+			return f(v, n);
+		}
+	} else if constexpr (std::is_same_v<T,uint64_t>) {
+		if (n >= detail::batch_dispatch_min) {
+			static const auto f = detail::max_flt_prec_u64_isa::select();
+			return f(v, n);
+		}
+	}
+	return detail::max_flt_prec(v, n);
+}
+
 }
 
 #endif
@@ -0,0 +1,224 @@
+/*
+ * packed-variant.hh
+ *
+ * Copyright 2018-2022 Franz Brauße <fb@paxle.org>
+ *
+ * See the LICENSE file for terms of distribution.
+ */
+
+#ifndef KAY_PACKED_VARIANT_HH
+#define KAY_PACKED_VARIANT_HH
+
+#include <cstdint>
+#include <cassert>
+#include <utility>	/* std::index_sequence */
+#include <tuple>	/* std::tuple_element_t */
+#include <type_traits>
+#include <variant>	/* std::bad_variant_access */
+
+#include <kay/bits.hh>
+
+namespace kay {
+
+/* How a value is stored in the payload of a packed_variant: the number of bits
+ * it needs, the number of low bits guaranteed to be zero and the conversions
+ * to and from an unsigned word. Specialize for other types. */
+template <typename T, typename = void> struct packed_traits;
+
+/* user-space addresses on current 64-bit platforms have at most 56
+ * significant bits */
+inline constexpr size_t packed_ptr_bits = type_bits_v<uintptr_t> < 56
+                                        ? type_bits_v<uintptr_t> : 56;
+
+template <typename T>
+struct packed_traits<T,std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T,bool>>> {
+	static constexpr size_t bits = type_bits_v<T>;
+	static constexpr size_t low_free = 0;
+	static constexpr uintptr_t to_word(T v) { return static_cast<std::make_unsigned_t<T>>(v); }
+	static constexpr T from_word(uintptr_t w) { return static_cast<T>(static_cast<std::make_unsigned_t<T>>(w)); }
+};
+
+template <>
+struct packed_traits<bool> {
+	static constexpr size_t bits = 1;
+	static constexpr size_t low_free = 0;
+	static constexpr uintptr_t to_word(bool v) { return v; }
+	static constexpr bool from_word(uintptr_t w) { return w & 1; }
+};
+
+/* enumerations need a kay::cardinality */
+template <typename T>
+struct packed_traits<T,std::enable_if_t<std::is_enum_v<T>>> {
+	using U = std::make_unsigned_t<std::underlying_type_t<T>>;
+	static constexpr size_t bits = max_bits_v<T>;
+	static constexpr size_t low_free = 0;
+	static constexpr uintptr_t to_word(T v) { return static_cast<U>(v); }
+	static constexpr T from_word(uintptr_t w) { return static_cast<T>(static_cast<U>(w)); }
+};
+
+template <>
+struct packed_traits<unit> {
+	static constexpr size_t bits = 0;
+	static constexpr size_t low_free = 0;
+	static constexpr uintptr_t to_word(unit) { return 0; }
+	static constexpr unit from_word(uintptr_t) { return {}; }
+};
+
+template <typename T>
+struct packed_traits<T *> {
+	static constexpr size_t bits = packed_ptr_bits;
+	static constexpr size_t low_free = std::is_void_v<T> || std::is_function_v<T>
+	                                 ? 0 : ceil_log2_v<alignof(std::conditional_t<std::is_void_v<T> || std::is_function_v<T>,char,T>)>;
+	static uintptr_t to_word(T *p) { return reinterpret_cast<uintptr_t>(p); }
+	static T * from_word(uintptr_t w) { return reinterpret_cast<T *>(w); }
+};
+
+template <size_t tag_sz, typename I, typename T, typename E>
+struct packed_traits<tagged_idx_base<tag_sz,I,T,E>> {
+	using V = tagged_idx_base<tag_sz,I,T,E>;
+	static constexpr size_t bits = type_bits_v<I>;
+	static constexpr size_t low_free = 0;
+	static uintptr_t to_word(const V &v) { return v.v; }
+	static V from_word(uintptr_t w) { V r; r.v = static_cast<I>(w); return r; }
+};
+
+/* A variant of Ts... stored in a single word. The index of the alternative
+ * occupies the lowest ceil_log2(sizeof...(Ts)) bits. Alternatives whose low
+ * bits are guaranteed to be zero, like sufficiently aligned pointers, are
+ * stored in place; the others are shifted left by the tag size, which
+ * requires their payload to fit into the remaining bits. The alternatives must
+ * be pairwise distinct. */
+template <typename... Ts>
+class packed_variant {
+
+	static_assert(sizeof...(Ts) > 0);
+
+	using word = uintptr_t;
+
+	static constexpr size_t n = sizeof...(Ts);
+	static constexpr size_t tag_bits = n > 1 ? ceil_log2_v<n> : 0;
+	static constexpr word tag_mask = ((word)1 << tag_bits) - 1;
+
+	template <typename T>
+	static constexpr bool in_place = packed_traits<T>::low_free >= tag_bits;
+
+	static_assert(((in_place<Ts> || packed_traits<Ts>::bits + tag_bits <= type_bits_v<word>) && ...),
+	              "alternative does not fit next to the tag");
+
+	template <size_t i>
+	using alt = std::tuple_element_t<i,std::tuple<Ts...>>;
+
+	template <typename T>
+	static constexpr bool is_alternative = (std::is_same_v<T,Ts> || ...);
+
+	template <typename T>
+	static constexpr size_t index_of()
+	{
+		static_assert(is_alternative<T>, "not an alternative");
+		constexpr bool is[] = { std::is_same_v<T,Ts>... };
+		size_t i = 0;
+		while (!is[i])
+			i++;
+		return i;
+	}
+
+	template <size_t i>
+	static word encode(const alt<i> &v)
+	{
+		word x = packed_traits<alt<i>>::to_word(v);
+		if constexpr (in_place<alt<i>>) {
+			assert(!(x & tag_mask));
+			return x | i;
+		} else {
+			assert(tag_bits + packed_traits<alt<i>>::bits >= type_bits_v<word> ||
+			       !(x >> (type_bits_v<word> - tag_bits)));
+			return x << tag_bits | i;
+		}
+	}
+
+	template <size_t i>
+	static alt<i> decode(word w)
+	{
+		if constexpr (in_place<alt<i>>)
+			return packed_traits<alt<i>>::from_word(w & ~tag_mask);
+		else
+			return packed_traits<alt<i>>::from_word(w >> tag_bits);
+	}
+
+	word w;
+
+	explicit packed_variant(word w, std::nullptr_t) : w(w) {}
+
+	template <typename F, size_t i>
+	static decltype(auto) call(F &&f, word w)
+	{
+		return std::forward<F>(f)(decode<i>(w));
+	}
+
+	template <typename F, size_t... is>
+	static decltype(auto) dispatch(F &&f, word w, std::index_sequence<is...>)
+	{
+		using R = decltype(call<F,0>(std::forward<F>(f), w));
+		static_assert((std::is_same_v<R,decltype(call<F,is>(std::forward<F>(f), w))> && ...),
+		              "visitor must return the same type for all alternatives");
+		static constexpr R (*const table[])(F &&, word) = { &call<F,is>... };
+		return table[w & tag_mask](std::forward<F>(f), w);
+	}
+
+public:
+	packed_variant() : packed_variant(alt<0> {}) {}
+
+	template <typename T, typename = std::enable_if_t<is_alternative<std::decay_t<T>>>>
+	packed_variant(T &&v) : w(encode<index_of<std::decay_t<T>>()>(v)) {}
+
+	template <typename T, typename = std::enable_if_t<is_alternative<std::decay_t<T>>>>
+	packed_variant & operator=(T &&v)
+	{
+		w = encode<index_of<std::decay_t<T>>()>(v);
+		return *this;
+	}
+
+	size_t index() const { return w & tag_mask; }
+
+	template <typename T>
+	bool holds() const { return index() == index_of<T>(); }
+
+	/* throws std::bad_variant_access if alternative i is not held */
+	template <size_t i>
+	alt<i> get() const
+	{
+		if (index() != i)
+			throw std::bad_variant_access();
+		return decode<i>(w);
+	}
+
+	template <typename T>
+	T get() const { return get<index_of<T>()>(); }
+
+	/* the encoding, which is unique for each value */
+	word raw() const { return w; }
+	static packed_variant from_raw(word w) { assert((w & tag_mask) < n); return packed_variant(w, nullptr); }
+
+	/* f(alternative) through a table indexed by the tag */
+	template <typename F>
+	friend decltype(auto) visit(F &&f, const packed_variant &v)
+	{
+		return dispatch(std::forward<F>(f), v.w, std::make_index_sequence<n>{});
+	}
+
+	friend bool operator==(const packed_variant &a, const packed_variant &b) { return a.w == b.w; }
+	friend bool operator!=(const packed_variant &a, const packed_variant &b) { return a.w != b.w; }
+};
+
+template <typename T, typename... Ts>
+bool holds_alternative(const packed_variant<Ts...> &v) { return v.template holds<T>(); }
+
+template <size_t i, typename... Ts>
+auto get(const packed_variant<Ts...> &v) { return v.template get<i>(); }
+
+template <typename T, typename... Ts>
+T get(const packed_variant<Ts...> &v) { return v.template get<T>(); }
+
+}
+
+#endif
@@ -0,0 +1,352 @@
+/*
+ * packed-vector.hh
+ *
+ * Copyright 2018-2022 Franz Brauße <fb@paxle.org>
+ *
+ * See the LICENSE file for terms of distribution.
+ */
+
+#ifndef KAY_PACKED_VECTOR_HH
+#define KAY_PACKED_VECTOR_HH
+
+#include <vector>
+#include <cassert>
+#include <iterator>	/* std::random_access_iterator_tag */
+#include <algorithm>	/* std::fill */
+
+#include <kay/bits.hh>
+
+namespace kay {
+
+/* Sequence of values of T stored in exactly max_bits_v<T> bits each, packed
+ * into 64-bit words; elements may straddle word boundaries. T must be an
+ * unsigned integral or an enumeration type with non-negative values, bool or
+ * unit, and have a kay::cardinality. */
+template <typename T>
+class packed_vector {
+
+	static constexpr size_t b = max_bits_v<T>;
+	static_assert(b <= 64);
+	static_assert(!std::is_integral_v<T> || !std::is_signed_v<T>);
+
+	static constexpr uint64_t mask = b == 64 ? ~(uint64_t)0 : ((uint64_t)1 << b) - 1;
+
+	std::vector<uint64_t> w;
+	size_t n = 0;
+
+	static constexpr uint64_t to_bits(T v)
+	{
+		if constexpr (b == 0)
+			return 0;
+		else if constexpr (std::is_enum_v<T>)
+			return static_cast<uint64_t>(static_cast<std::underlying_type_t<T>>(v));
+		else
+			return static_cast<uint64_t>(v);
+	}
+
+	static constexpr T from_bits(uint64_t v)
+	{
+		if constexpr (b == 0)
+			return T {};
+		else
+			return static_cast<T>(v);
+	}
+
+	static constexpr size_t words(size_t k) { return (k * b + 63) / 64; }
+
+	uint64_t get_bits(size_t i) const
+	{
+		size_t p = i * b, k = p / 64, o = p % 64;
+		uint64_t r = w[k] >> o;
+		if (o + b > 64)
+			r |= w[k+1] << (64 - o);
+		return r & mask;
+	}
+
+	void set_bits(size_t i, uint64_t v)
+	{
+		size_t p = i * b, k = p / 64, o = p % 64;
+		w[k] = (w[k] & ~(mask << o)) | v << o;
+		if (o + b > 64)
+			w[k+1] = (w[k+1] & ~(mask >> (64 - o))) | v >> (64 - o);
+	}
+
+public:
+	class reference {
+		friend class packed_vector;
+		packed_vector *v;
+		size_t i;
+		reference(packed_vector *v, size_t i) : v(v), i(i) {}
+	public:
+		operator T() const { return v->get(i); }
+		reference & operator=(T x) { v->set(i, x); return *this; }
+		reference & operator=(const reference &r) { return *this = (T)r; }
+	};
+
+	class const_iterator {
+		friend class packed_vector;
+		const packed_vector *v;
+		size_t i;
+		const_iterator(const packed_vector *v, size_t i) : v(v), i(i) {}
+	public:
+		using iterator_category = std::random_access_iterator_tag;
+		using value_type        = T;
+		using difference_type   = ptrdiff_t;
+		using pointer           = void;
+		using reference         = T;
+
+		const_iterator() = default;
+		T operator*() const { return v->get(i); }
+		T operator[](difference_type k) const { return v->get(i + k); }
+		const_iterator & operator++() { ++i; return *this; }
+		const_iterator & operator--() { --i; return *this; }
+		const_iterator operator++(int) { const_iterator r = *this; ++i; return r; }
+		const_iterator operator--(int) { const_iterator r = *this; --i; return r; }
+		const_iterator & operator+=(difference_type k) { i += k; return *this; }
+		const_iterator & operator-=(difference_type k) { i -= k; return *this; }
+		friend const_iterator operator+(const_iterator a, difference_type k) { return a += k; }
+		friend const_iterator operator-(const_iterator a, difference_type k) { return a -= k; }
+		friend difference_type operator-(const const_iterator &a, const const_iterator &b)
+		{ return a.i - b.i; }
+		friend bool operator==(const const_iterator &a, const const_iterator &b) { return a.i == b.i; }
+		friend bool operator!=(const const_iterator &a, const const_iterator &b) { return a.i != b.i; }
+		friend bool operator< (const const_iterator &a, const const_iterator &b) { return a.i <  b.i; }
+	};
+
+	static constexpr size_t element_bits = b;
+
+	packed_vector() = default;
+	explicit packed_vector(size_t n, T v = T {}) { resize(n, v); }
+
+	size_t size() const { return n; }
+	bool empty() const { return !n; }
+	size_t capacity() const { return b ? w.capacity() * 64 / b : ~(size_t)0; }
+
+	void reserve(size_t k) { w.reserve(words(k)); }
+	void clear() { w.clear(); n = 0; }
+
+	void resize(size_t k, T v = T {})
+	{
+		size_t m = n;
+		w.resize(words(k));
+		n = k;
+		if (k > m)
+			fill(m, k - m, v);
+		else if (b && k * b % 64)
+			/* keep the bits beyond the end zero */
+			w.back() &= ((uint64_t)1 << (k * b % 64)) - 1;
+	}
+
+	void push_back(T v)
+	{
+		if (words(n + 1) > w.size())
+			w.push_back(0);
+		set_bits(n++, to_bits(v));
+	}
+
+	void pop_back() { assert(n); set_bits(--n, 0); w.resize(words(n)); }
+
+	T get(size_t i) const { assert(i < n); return b ? from_bits(get_bits(i)) : T {}; }
+	void set(size_t i, T v) { assert(i < n); if (b) set_bits(i, to_bits(v)); }
+
+	T operator[](size_t i) const { return get(i); }
+	reference operator[](size_t i) { return { this, i }; }
+
+	T front() const { return get(0); }
+	T back() const { return get(n-1); }
+
+	const_iterator begin() const { return { this, 0 }; }
+	const_iterator end() const { return { this, n }; }
+
+	/* the packed words, bits beyond size()*element_bits are zero */
+	const uint64_t * data() const { return w.data(); }
+
+	/* v for positions [first,first+k) */
+	void fill(size_t first, size_t k, T v)
+	{
+		assert(first + k <= n);
+		if constexpr (b == 0)
+			return;
+		uint64_t x = to_bits(v);
+		if constexpr (b && 64 % b == 0) {
+			uint64_t pat = 0;
+			for (size_t j=0; j<64; j+=b)
+				pat |= x << j;
+			/* head and tail element-wise, full words at once */
+			for (; k && first * b % 64; first++, k--)
+				set_bits(first, x);
+			size_t q = first * b / 64;
+			for (; k >= 64 / b; k -= 64 / b, first += 64 / b)
+				w[q++] = pat;
+		}
+		for (; k; first++, k--)
+			set_bits(first, x);
+	}
+
+	/* Unpacks the elements [first,first+k) into out. For element sizes
+	 * dividing 64 this processes whole words with fixed shifts, which
+	 * compilers vectorize. */
+	void get(size_t first, size_t k, T *out) const
+	{
+		assert(first + k <= n);
+		if constexpr (b == 0) {
+			std::fill(out, out + k, T {});
+			return;
+		}
+		if constexpr (b && 64 % b == 0) {
+			constexpr size_t per = 64 / b;
+			for (; k && first % per; k--)
+				*out++ = from_bits(get_bits(first++));
+			const uint64_t *p = w.data() + first / per;
+			for (; k >= per; k -= per, first += per, out += per) {
+				uint64_t x = *p++;
+				for (size_t j=0; j<per; j++)
+					out[j] = from_bits(x >> (j * b) & mask);
+			}
+			for (; k; k--)
+				*out++ = from_bits(get_bits(first++));
+		} else {
+			/* sequential bit reader over the words */
+			size_t p = first * b, q = p / 64, o = p % 64;
+			for (; k; k--) {
+				uint64_t r = w[q] >> o;
+				if (o + b > 64)
+					r |= w[q+1] << (64 - o);
+				*out++ = from_bits(r & mask);
+				o += b;
+				q += o / 64;
+				o %= 64;
+			}
+		}
+	}
+
+	/* packs in[0,k) into the positions [first,first+k) */
+	void set(size_t first, size_t k, const T *in)
+	{
+		assert(first + k <= n);
+		if constexpr (b == 0)
+			return;
+		if constexpr (b && 64 % b == 0) {
+			constexpr size_t per = 64 / b;
+			for (; k && first % per; k--)
+				set_bits(first++, to_bits(*in++));
+			uint64_t *p = w.data() + first / per;
+			for (; k >= per; k -= per, first += per, in += per) {
+				uint64_t x = 0;
+				for (size_t j=0; j<per; j++)
+					x |= to_bits(in[j]) << (j * b);
+				*p++ = x;
+			}
+		}
+		for (; k; k--)
+			set_bits(first++, to_bits(*in++));
+	}
+
+	/* number of elements equal to v */
+	size_t count(T v) const
+	{
+		if constexpr (b == 1) {
+			size_t c = 0;
+			for (uint64_t x : w)
+				c += __builtin_popcountll(x);
+			return to_bits(v) ? c : n - c;
+		} else {
+			size_t c = 0;
+			for (size_t i=0; i<n; i++)
+				c += get(i) == v;
+			return c;
+		}
+	}
+
+	friend bool operator==(const packed_vector &a, const packed_vector &b)
+	{
+		return a.n == b.n && a.w == b.w;
+	}
+
+	friend bool operator!=(const packed_vector &a, const packed_vector &b)
+	{
+		return !(a == b);
+	}
+};
+
+/* Rank and select over a snapshot of a 1-bit packed_vector. The index stores
+ * the number of ones before each block of 8 words: rank takes constant time,
+ * select a binary search over the blocks, i.e., O(log n). */
+class rank_select {
+
+	static constexpr size_t block_words = 8;
+
+	const uint64_t *w;
+	size_t n, nw;
+	std::vector<size_t> blocks; /* ones before block i */
+
+	static unsigned select_in_word(uint64_t x, size_t k)
+	{
+		for (; k; k--)
+			x &= x - 1;
+		return __builtin_ctzll(x);
+	}
+
+public:
+	/* v must not be modified during the lifetime of the index */
+	template <typename T, typename = std::enable_if_t<max_bits_v<T> == 1>>
+	explicit rank_select(const packed_vector<T> &v)
+	: w(v.data()), n(v.size()), nw((n + 63) / 64)
+	, blocks(nw / block_words + 2)
+	{
+		size_t c = 0;
+		for (size_t i=0; i<nw; i++) {
+			if (i % block_words == 0)
+				blocks[i / block_words] = c;
+			c += __builtin_popcountll(w[i]);
+		}
+		blocks[(nw + block_words - 1) / block_words] = c;
+		blocks.resize((nw + block_words - 1) / block_words + 1);
+	}
+
+	size_t size() const { return n; }
+
+	/* number of ones */
+	size_t ones() const { return blocks.back(); }
+
+	/* number of ones in positions [0,i) */
+	size_t rank(size_t i) const
+	{
+		assert(i <= n);
+		size_t q = i / 64, k = q / block_words;
+		size_t c = blocks[k];
+		for (size_t j=k*block_words; j<q; j++)
+			c += __builtin_popcountll(w[j]);
+		if (i % 64)
+			c += __builtin_popcountll(w[q] & (((uint64_t)1 << (i % 64)) - 1));
+		return c;
+	}
+
+	/* position of the one with rank k, requires k < ones() */
+	size_t select(size_t k) const
+	{
+		assert(k < ones());
+		/* last block starting with at most k ones before it */
+		size_t lo = 0, hi = blocks.size() - 1;
+		while (hi - lo > 1) {
+			size_t m = lo + (hi - lo) / 2;
+			if (blocks[m] <= k)
+				lo = m;
+			else
+				hi = m;
+		}
+		k -= blocks[lo];
+		size_t q = lo * block_words;
+		for (;; q++) {
+			size_t c = __builtin_popcountll(w[q]);
+			if (k < c)
+				break;
+			k -= c;
+		}
+		return q * 64 + select_in_word(w[q], k);
+	}
+};
+
+}
+
+#endif
@@ -0,0 +1,420 @@
+/*
+ * parallel.hh
+ *
+ * Copyright 2018-2022 Franz Brauße <fb@paxle.org>
+ *
+ * See the LICENSE file for terms of distribution.
+ */
+
+#ifndef KAY_PARALLEL_HH
+#define KAY_PARALLEL_HH
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <vector>
+#include <memory>	/* std::shared_ptr, std::unique_ptr */
+#include <functional>	/* std::function */
+#include <exception>	/* std::exception_ptr */
+#include <utility>	/* std::pair */
+#include <algorithm>	/* std::min, std::max */
+
+#include <kay/numbers.hh>
+#include <kay/numbits.hh>	/* detail::mpz_of */
+
+namespace kay {
+
+namespace parallel {
+
+/* Runs f(0), ..., f(n-1) and returns once all calls have finished, possibly
+ * calling f on the calling thread. Must support being called from within f. */
+using executor = std::function<void(size_t n, const std::function<void(size_t)> &f)>;
+
+/* Fixed set of worker threads executing batches of tasks. The thread calling
+ * run() works on its own batch, too, which keeps nested calls from
+ * deadlocking. The first exception thrown by a task is rethrown by run(). */
+class thread_pool {
+
+	struct batch {
+		const std::function<void(size_t)> &f;
+		size_t n;
+		std::atomic<size_t> next, done;
+		std::mutex m;
+		std::condition_variable cv;
+		std::exception_ptr err;
+
+		batch(const std::function<void(size_t)> &f, size_t n) : f(f), n(n), next(0), done(0) {}
+	};
+
+	std::vector<std::thread> workers;
+	std::deque<std::shared_ptr<batch>> q;
+	std::mutex m;
+	std::condition_variable cv;
+	bool stop = false;
+
+	static void work(batch &b)
+	{
+		for (size_t i; (i = b.next.fetch_add(1)) < b.n;) {
+			try {
+				b.f(i);
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(b.m);
+				if (!b.err)
+					b.err = std::current_exception();
+			}
+			if (b.done.fetch_add(1) + 1 == b.n) {
+				std::lock_guard<std::mutex> lock(b.m);
+				b.cv.notify_all();
+			}
+		}
+	}
+
+	void loop()
+	{
+		for (;;) {
+			std::shared_ptr<batch> b;
+			{
+				std::unique_lock<std::mutex> lock(m);
+				cv.wait(lock, [this]{ return stop || !q.empty(); });
+				if (stop)
+					return;
+				b = std::move(q.front());
+				q.pop_front();
+			}
+			work(*b);
+		}
+	}
+
+public:
+	/* n - 1 workers besides the calling threads */
+	explicit thread_pool(unsigned n)
+	{
+		for (unsigned i=1; i<n; i++)
+			workers.emplace_back([this]{ loop(); });
+	}
+
+	thread_pool(const thread_pool &) = delete;
+	thread_pool & operator=(const thread_pool &) = delete;
+
+	~thread_pool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m);
+			stop = true;
+		}
+		cv.notify_all();
+		for (std::thread &t : workers)
+			t.join();
+	}
+
+	unsigned size() const { return workers.size() + 1; }
+
+	void run(size_t n, const std::function<void(size_t)> &f)
+	{
+		if (n <= 1 || workers.empty()) {
+			for (size_t i=0; i<n; i++)
+				f(i);
+			return;
+		}
+		auto b = std::make_shared<batch>(f, n);
+		{
+			std::lock_guard<std::mutex> lock(m);
+			for (size_t i=0; i<std::min(n - 1, workers.size()); i++)
+				q.push_back(b);
+		}
+		cv.notify_all();
+		work(*b);
+		std::unique_lock<std::mutex> lock(b->m);
+		b->cv.wait(lock, [&]{ return b->done.load() == n; });
+		if (b->err)
+			std::rethrow_exception(b->err);
+	}
+};
+
+namespace detail {
+
+struct config {
+	std::mutex m;
+	unsigned threads = std::max(std::thread::hardware_concurrency(), 1U);
+	executor exec;
+	std::unique_ptr<thread_pool> pool;
+};
+
+inline config & cfg()
+{
+	static config c;
+	return c;
+}
+
+}
+
+/* number of threads the parallel operations use */
+inline unsigned threads()
+{
+	detail::config &c = detail::cfg();
+	std::lock_guard<std::mutex> lock(c.m);
+	return c.threads;
+}
+
+/* Sets the number of threads of the built-in pool and, with the flint
+ * backend, of flint's own. Must not be called while parallel operations run. */
+inline void set_threads(unsigned n)
+{
+	detail::config &c = detail::cfg();
+	std::lock_guard<std::mutex> lock(c.m);
+	c.threads = std::max(n, 1U);
+	c.pool.reset();
+#if (KAY_USE_FLINT-0)
+	flint_set_num_threads(c.threads);
+#endif
+}
+
+/* Replaces the built-in pool by e, which runs up to n tasks at once, e.g. to
+ * share the workers of an application's pool instead of oversubscribing the
+ * machine. An empty e reinstates the built-in pool. */
+inline void set_executor(executor e, unsigned n)
+{
+	detail::config &c = detail::cfg();
+	{
+		std::lock_guard<std::mutex> lock(c.m);
+		c.exec = std::move(e);
+	}
+	set_threads(n);
+}
+
+/* f(0), ..., f(n-1) on the configured executor */
+inline void run(size_t n, const std::function<void(size_t)> &f)
+{
+	detail::config &c = detail::cfg();
+	std::unique_lock<std::mutex> lock(c.m);
+	if (c.threads <= 1 || n <= 1) {
+		lock.unlock();
+		for (size_t i=0; i<n; i++)
+			f(i);
+		return;
+	}
+	if (c.exec) {
+		executor e = c.exec;
+		lock.unlock();
+		e(n, f);
+		return;
+	}
+	if (!c.pool)
+		c.pool = std::make_unique<thread_pool>(c.threads);
+	thread_pool &p = *c.pool;
+	lock.unlock();
+	p.run(n, f);
+}
+
+/* operands of the parallel operations with fewer limbs are handled by a single
+ * call to the backend */
+static constexpr size_t min_limbs = 4096;
+
+namespace detail {
+
+static_assert(GMP_NAIL_BITS == 0);
+
+/* read-only view of the limbs [off, off+len) of |v| */
+inline __mpz_struct limbs(mpz_srcptr v, size_t off, size_t len)
+{
+	const mp_limb_t *d = v->_mp_d + off;
+	while (len && !d[len-1])
+		len--;
+	__mpz_struct r;
+	r._mp_alloc = 0;
+	r._mp_size = len;
+	r._mp_d = const_cast<mp_limb_t *>(d);
+	return r;
+}
+
+inline size_t size(mpz_srcptr v) { return mpz_size(v); }
+
+/* r = a * b for a, b >= 0 on up to par threads; r must not alias a or b */
+inline void mul(mpz_ptr r, mpz_srcptr a, mpz_srcptr b, unsigned par)
+{
+	if (size(a) < size(b))
+		std::swap(a, b);
+	size_t n = size(a), m = size(b);
+	if (par <= 1 || m < min_limbs) {
+		mpz_mul(r, a, b);
+		return;
+	}
+	if (n >= 2 * m) {
+		/* a in k pieces of at least m limbs each times b */
+		size_t k = std::min<size_t>(par, n / m), c = (n + k - 1) / k;
+		std::vector<mpz_class> p(k);
+		run(k, [&](size_t i){
+			__mpz_struct ai = limbs(a, i * c, std::min(c, n - i * c));
+			mul(p[i].get_mpz_t(), &ai, b, std::max<unsigned>(par / k, 1));
+		});
+		mpz_set_ui(r, 0);
+		for (size_t i=k; i--;) {
+			mpz_mul_2exp(r, r, c * GMP_NUMB_BITS);
+			mpz_add(r, r, p[i].get_mpz_t());
+		}
+		return;
+	}
+	/* one level of Karatsuba with the three products in parallel */
+	size_t h = m / 2;
+	__mpz_struct a0 = limbs(a, 0, h), a1 = limbs(a, h, n - h);
+	__mpz_struct b0 = limbs(b, 0, h), b1 = limbs(b, h, m - h);
+	mpz_class z[3], sa, sb;
+	mpz_add(sa.get_mpz_t(), &a0, &a1);
+	mpz_add(sb.get_mpz_t(), &b0, &b1);
+	unsigned sub = std::max<unsigned>(par / 3, 1);
+	run(3, [&](size_t i){
+		switch (i) {
+		case 0: mul(z[0].get_mpz_t(), &a0, &b0, sub); break;
+		case 1: mul(z[1].get_mpz_t(), sa.get_mpz_t(), sb.get_mpz_t(), sub); break;
+		case 2: mul(z[2].get_mpz_t(), &a1, &b1, sub); break;
+		}
+	});
+	mpz_sub(z[1].get_mpz_t(), z[1].get_mpz_t(), z[0].get_mpz_t());
+	mpz_sub(z[1].get_mpz_t(), z[1].get_mpz_t(), z[2].get_mpz_t());
+	mpz_mul_2exp(r, z[2].get_mpz_t(), h * GMP_NUMB_BITS);
+	mpz_add(r, r, z[1].get_mpz_t());
+	mpz_mul_2exp(r, r, h * GMP_NUMB_BITS);
+	mpz_add(r, r, z[0].get_mpz_t());
+}
+
+inline void mul(mpz_ptr r, mpz_srcptr a, mpz_srcptr b)
+{
+	__mpz_struct x = *a, y = *b;
+	x._mp_size = mpz_size(a);
+	y._mp_size = mpz_size(b);
+	bool neg = mpz_sgn(a) * mpz_sgn(b) < 0;
+	mpz_class t;
+	mul(t.get_mpz_t(), &x, &y, threads());
+	mpz_swap(r, t.get_mpz_t());
+	if (neg)
+		mpz_neg(r, r);
+}
+
+/* x ~ 2^(bits(b)+k) / b for b > 0 within a few units */
+inline mpz_class reciprocal(mpz_srcptr b, size_t k)
+{
+	size_t m = mpz_sizeinbase(b, 2);
+	/* the leading k+8 bits of b determine the result to the precision needed */
+	size_t s = m > k + 8 ? m - (k + 8) : 0, mt = m - s;
+	mpz_class bt;
+	mpz_tdiv_q_2exp(bt.get_mpz_t(), b, s);
+	mpz_class x;
+	if (k <= 64 * min_limbs) {
+		mpz_class t;
+		mpz_setbit(t.get_mpz_t(), mt + k);
+		mpz_tdiv_q(x.get_mpz_t(), t.get_mpz_t(), bt.get_mpz_t());
+		return x;
+	}
+	/* Newton: x = y * 2^(k-h) + y * (2^(mt+h) - bt*y) / 2^(mt+2h-k) */
+	size_t h = k / 2 + 8;
+	mpz_class y = reciprocal(bt.get_mpz_t(), h), e, t;
+	mul(e.get_mpz_t(), bt.get_mpz_t(), y.get_mpz_t());
+	mpz_set_ui(t.get_mpz_t(), 0);
+	mpz_setbit(t.get_mpz_t(), mt + h);
+	mpz_sub(e.get_mpz_t(), t.get_mpz_t(), e.get_mpz_t());
+	mul(t.get_mpz_t(), y.get_mpz_t(), e.get_mpz_t());
+	mpz_fdiv_q_2exp(t.get_mpz_t(), t.get_mpz_t(), mt + 2 * h - k);
+	mpz_mul_2exp(x.get_mpz_t(), y.get_mpz_t(), k - h);
+	mpz_add(x.get_mpz_t(), x.get_mpz_t(), t.get_mpz_t());
+	return x;
+}
+
+/* q = floor(a / b), r = a - q*b for b != 0 */
+inline void divmod(mpz_ptr q, mpz_ptr r, mpz_srcptr a, mpz_srcptr b)
+{
+	size_t n = mpz_sizeinbase(a, 2), m = mpz_sizeinbase(b, 2);
+	if (threads() <= 1 || mpz_size(b) < min_limbs || n < m + 64 * min_limbs) {
+		mpz_fdiv_qr(q, r, a, b);
+		return;
+	}
+	__mpz_struct aa = *a, bb = *b;
+	aa._mp_size = mpz_size(a);
+	bb._mp_size = mpz_size(b);
+	/* |a|/|b| < 2^k */
+	size_t k = n - m + 1;
+	mpz_class x = reciprocal(&bb, k + 4), at, qq, rr, c;
+	size_t sa = n > k + 8 ? n - (k + 8) : 0;
+	mpz_tdiv_q_2exp(at.get_mpz_t(), &aa, sa);
+	mul(qq.get_mpz_t(), at.get_mpz_t(), x.get_mpz_t());
+	mpz_tdiv_q_2exp(qq.get_mpz_t(), qq.get_mpz_t(), m + k + 4 - sa);
+	/* qq is off by a few units, the remainder tells by how many */
+	mul(rr.get_mpz_t(), qq.get_mpz_t(), &bb);
+	mpz_sub(rr.get_mpz_t(), &aa, rr.get_mpz_t());
+	mpz_fdiv_qr(c.get_mpz_t(), rr.get_mpz_t(), rr.get_mpz_t(), &bb);
+	mpz_add(qq.get_mpz_t(), qq.get_mpz_t(), c.get_mpz_t());
+	/* |a| = qq*|b| + rr with 0 <= rr < |b|; now to floor semantics */
+	if (mpz_sgn(a) != mpz_sgn(b)) {
+		mpz_neg(qq.get_mpz_t(), qq.get_mpz_t());
+		if (mpz_sgn(rr.get_mpz_t())) {
+			mpz_sub_ui(qq.get_mpz_t(), qq.get_mpz_t(), 1);
+			mpz_sub(rr.get_mpz_t(), &bb, rr.get_mpz_t());
+		}
+	}
+	if (mpz_sgn(b) < 0)
+		mpz_neg(rr.get_mpz_t(), rr.get_mpz_t());
+	mpz_swap(q, qq.get_mpz_t());
+	mpz_swap(r, rr.get_mpz_t());
+}
+
+#if (KAY_USE_FLINT-0)
+inline mpz_srcptr mpz_of(const Z &v, __mpz_struct &t, mp_limb_t &l)
+{
+	return kay::detail::mpz_of(*v.get_fmpz_t(), t, l);
+}
+
+inline Z from(mpz_class &&v) { Z r; fmpz_set_mpz(r.get_fmpz_t(), v.get_mpz_t()); return r; }
+#else
+inline mpz_srcptr mpz_of(const Z &v, __mpz_struct &, mp_limb_t &) { return v.get_mpz_t(); }
+inline Z from(mpz_class &&v) { return std::move(v); }
+#endif
+
+}
+
+/* a * b; with operands of at least min_limbs limbs, split into products
+ * computed in parallel */
+inline Z mul(const Z &a, const Z &b)
+{
+	__mpz_struct ta, tb;
+	mp_limb_t la, lb;
+	mpz_class r;
+	detail::mul(r.get_mpz_t(), detail::mpz_of(a, ta, la), detail::mpz_of(b, tb, lb));
+	return detail::from(std::move(r));
+}
+
+/* a^e by squaring with mul() */
+inline Z pow(const Z &a, unsigned long e)
+{
+	if (!e)
+		return Z(1);
+	__mpz_struct ta;
+	mp_limb_t la;
+	mpz_srcptr av = detail::mpz_of(a, ta, la);
+	mpz_class r(av), t;
+	for (unsigned i = type_bits_v<unsigned long> - __builtin_clzl(e) - 1; i--;) {
+		detail::mul(t.get_mpz_t(), r.get_mpz_t(), r.get_mpz_t());
+		if (e >> i & 1)
+			detail::mul(r.get_mpz_t(), t.get_mpz_t(), av);
+		else
+			mpz_swap(r.get_mpz_t(), t.get_mpz_t());
+	}
+	return detail::from(std::move(r));
+}
+
+/* floor(a / b) and a - b*floor(a / b) for b != 0; for huge quotients via a
+ * Newton reciprocal of b and mul() */
+inline std::pair<Z,Z> divmod(const Z &a, const Z &b)
+{
+	__mpz_struct ta, tb;
+	mp_limb_t la, lb;
+	mpz_class q, r;
+	detail::divmod(q.get_mpz_t(), r.get_mpz_t(), detail::mpz_of(a, ta, la), detail::mpz_of(b, tb, lb));
+	return { detail::from(std::move(q)), detail::from(std::move(r)) };
+}
+
+}
+
+}
+
+#endif
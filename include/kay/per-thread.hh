@@ -0,0 +1,95 @@
+/*
+ * per-thread.hh
+ *
+ * Copyright 2018-2022 Franz Brauße <fb@paxle.org>
+ *
+ * See the LICENSE file for terms of distribution.
+ */
+
+#ifndef KAY_PER_THREAD_HH
+#define KAY_PER_THREAD_HH
+
+#include <mutex>
+
+namespace kay::detail {
+
+/* One instance of T per thread, created on first use by that thread, linked
+ * into a registry from which other threads can read them. When a thread exits,
+ * its instance is merged into the registry's Exited part by calling
+ * T::retire(Exited &) with the registry locked.
+ *
+ * The registry is never destroyed: threads may still exit after the static
+ * destructors ran. */
+template <typename T, typename Exited>
+class per_thread {
+
+	struct slot {
+		T v;
+		slot *prev = nullptr, *next = nullptr;
+		unsigned id;
+
+		slot();
+		~slot();
+	};
+
+	struct registry {
+		std::mutex m;
+		slot *head = nullptr;
+		Exited exited {};
+		unsigned next_id = 0;
+	};
+
+	static registry & reg()
+	{
+		static registry &r = *new registry;
+		return r;
+	}
+
+public:
+	/* the calling thread's instance */
+	static T & local()
+	{
+		static thread_local slot s;
+		return s.v;
+	}
+
+	/* With the registry locked, calls e(exited) and then t(id, v) for the
+	 * instance v of each running thread, most recently started first; ids
+	 * are assigned in the order the instances were created. */
+	template <typename E, typename F>
+	static void visit(E &&e, F &&t)
+	{
+		registry &r = reg();
+		std::lock_guard<std::mutex> lock(r.m);
+		e(r.exited);
+		for (slot *s = r.head; s; s = s->next)
+			t(s->id, s->v);
+	}
+};
+
+template <typename T, typename Exited>
+per_thread<T,Exited>::slot::slot()
+{
+	registry &r = reg();
+	std::lock_guard<std::mutex> lock(r.m);
+	id = r.next_id++;
+	next = r.head;
+	if (next)
+		next->prev = this;
+	r.head = this;
+}
+
+template <typename T, typename Exited>
+per_thread<T,Exited>::slot::~slot()
+{
+	registry &r = reg();
+	std::lock_guard<std::mutex> lock(r.m);
+	v.retire(r.exited);
+	(prev ? prev->next : r.head) = next;
+	if (next)
+		next->prev = prev;
+}
+
+}
+
+#endif
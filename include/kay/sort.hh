@@ -0,0 +1,358 @@
+/*
+ * sort.hh
+ *
+ * Copyright 2018-2022 Franz Brauße <fb@paxle.org>
+ *
+ * See the LICENSE file for terms of distribution.
+ */
+
+#ifndef KAY_SORT_HH
+#define KAY_SORT_HH
+
+#include <cstring>	/* memcpy */
+#include <cmath>	/* std::nextafter, std::isinf */
+#include <cfloat>	/* DBL_MAX */
+#include <vector>
+#include <functional>	/* std::function, std::ref */
+#include <iterator>	/* std::iterator_traits */
+#include <algorithm>	/* std::sort, std::nth_element, std::min */
+#include <type_traits>
+
+#include <kay/numbits.hh>	/* detail::mpz_of */
+#include <kay/parallel.hh>	/* parallel::run, parallel::threads */
+
+namespace kay {
+
+namespace sort_detail {
+
+/* Each element is mapped to an enclosure [lo, hi] of unsigned keys such that
+ * x < y implies lo(x) <= hi(y): disjoint enclosures order their elements, only
+ * elements with overlapping ones need to be compared exactly. */
+struct enclosure {
+	uint64_t lo, hi;
+};
+
+/* order-preserving on the non-NaN doubles, -0 being below +0 */
+inline uint64_t key_of(double d)
+{
+	uint64_t x;
+	memcpy(&x, &d, sizeof(x));
+	return x >> 63 ? ~x : x | (uint64_t)1 << 63;
+}
+
+inline enclosure enclose(mpz_srcptr num, mpz_srcptr den)
+{
+	int s = mpz_sgn(num);
+	if (!s)
+		return { key_of(0.0), key_of(0.0) };
+	__mpq_struct q;
+	q._mp_num = *num;
+	q._mp_den = *den;
+	/* truncated towards zero, infinite on overflow */
+	double d = mpq_get_d(&q);
+	if (std::isinf(d))
+		d = s < 0 ? -DBL_MAX : DBL_MAX;
+	double e = std::nextafter(d, s < 0 ? -HUGE_VAL : HUGE_VAL);
+	return s < 0 ? enclosure { key_of(e), key_of(d) }
+	             : enclosure { key_of(d), key_of(e) };
+}
+
+/* For Z, the key is the sign, the bit length (saturated at 2^23-1) and the 40
+ * leading bits of the magnitude, which is exact up to 40 bits. */
+inline enclosure enclose(mpz_srcptr v)
+{
+	static_assert(GMP_NUMB_BITS == 64);
+	constexpr unsigned lead = 40;
+	constexpr uint64_t max_len = ((uint64_t)1 << (63 - lead)) - 1;
+	size_t n = v->_mp_size < 0 ? -(size_t)v->_mp_size : v->_mp_size;
+	if (!n)
+		return { (uint64_t)1 << 63, (uint64_t)1 << 63 };
+	const mp_limb_t *d = v->_mp_d;
+	unsigned c = __builtin_clzll(d[n-1]);
+	uint64_t len = n * 64 - c, t;
+	bool exact;
+	if (len <= lead) {
+		t = d[0];
+		exact = true;
+	} else if (n == 1) {
+		t = d[0] >> (len - lead);
+		exact = !(d[0] & (((uint64_t)1 << (len - lead)) - 1));
+	} else {
+		t = detail::mpz_top64(v).t >> (64 - lead);
+		exact = false;
+	}
+	enclosure r;
+	if (len > max_len) {
+		r.lo = (uint64_t)1 << 63 | max_len << lead;
+		r.hi = (uint64_t)1 << 63 | max_len << lead | (((uint64_t)1 << lead) - 1);
+	} else {
+		r.lo = (uint64_t)1 << 63 | len << lead | t;
+		r.hi = r.lo + !exact;
+	}
+	if (v->_mp_size < 0)
+		r = { ~r.hi, ~r.lo };
+	return r;
+}
+
+inline enclosure enclose(const Z &v)
+{
+#if (KAY_USE_FLINT-0)
+	__mpz_struct t;
+	mp_limb_t l;
+	return enclose(detail::mpz_of(*v.get_fmpz_t(), t, l));
+#else
+	return enclose(v.get_mpz_t());
+#endif
+}
+
+inline enclosure enclose(const Q &v)
+{
+#if (KAY_USE_FLINT-0)
+	__mpz_struct tn, td;
+	mp_limb_t ln, ld;
+	const fmpq *q = v.get_fmpq_t();
+	return enclose(detail::mpz_of(q->num, tn, ln), detail::mpz_of(q->den, td, ld));
+#else
+	return enclose(v.get_num_mpz_t(), v.get_den_mpz_t());
+#endif
+}
+
+/* below this size everything runs on the calling thread */
+static constexpr size_t parallel_min = (size_t)1 << 16;
+static constexpr size_t chunk = (size_t)1 << 14;
+
+inline unsigned n_threads(size_t n)
+{
+	return n < parallel_min ? 1 : parallel::threads();
+}
+
+/* runs f(0), ..., f(tasks-1) on the executor of kay::parallel unless threads
+ * is 1 */
+template <typename F>
+void run(unsigned threads, size_t tasks, F &&f)
+{
+	if (threads <= 1) {
+		for (size_t i=0; i<tasks; i++)
+			f(i);
+		return;
+	}
+	parallel::run(tasks, std::function<void(size_t)>(std::ref(f)));
+}
+
+/* f(b, e) on the chunks [b, e) of [0, n) */
+template <typename F>
+void run_chunked(unsigned threads, size_t n, F &&f)
+{
+	run(threads, (n + chunk - 1) / chunk, [&](size_t i){
+		f(i * chunk, std::min(n, (i + 1) * chunk));
+	});
+}
+
+struct entry {
+	uint64_t k;
+	size_t i;
+};
+
+/* sorts a[0,n) by the bits of k below the bit at position 'bits' with LSD
+ * radix passes over bytes, skipping those on which all entries agree; t is
+ * scratch space of the same size */
+inline void lsd_sort(entry *a, entry *t, size_t n, unsigned bits)
+{
+	if (n < 64) {
+		std::sort(a, a + n, [](const entry &x, const entry &y){ return x.k < y.k; });
+		return;
+	}
+	unsigned passes = (bits + 7) / 8;
+	std::vector<size_t> cnt(passes * 256);
+	for (size_t j=0; j<n; j++)
+		for (unsigned p=0; p<passes; p++)
+			cnt[p * 256 + (a[j].k >> 8 * p & 0xff)]++;
+	entry *src = a, *dst = t;
+	for (unsigned p=0; p<passes; p++) {
+		size_t *c = &cnt[p * 256];
+		if (c[src[0].k >> 8 * p & 0xff] == n)
+			continue;
+		for (size_t d=0, s=0; d<256; d++) {
+			size_t m = c[d];
+			c[d] = s;
+			s += m;
+		}
+		for (size_t j=0; j<n; j++)
+			dst[c[src[j].k >> 8 * p & 0xff]++] = src[j];
+		std::swap(src, dst);
+	}
+	if (src != a)
+		std::copy(src, src + n, a);
+}
+
+/* sorts a by k; the top 11 varying bits split the input into buckets, which
+ * are sorted in parallel */
+inline void sort_keys(std::vector<entry> &a, unsigned threads)
+{
+	size_t n = size(a);
+	std::vector<entry> t(n);
+	if (threads <= 1) {
+		lsd_sort(a.data(), t.data(), n, 64);
+		return;
+	}
+	constexpr unsigned split = 11;
+	constexpr size_t nb = (size_t)1 << split;
+	uint64_t lo = a[0].k, hi = a[0].k;
+	for (const entry &e : a) {
+		lo = std::min(lo, e.k);
+		hi = std::max(hi, e.k);
+	}
+	if (lo == hi)
+		return;
+	unsigned bits = 64 - __builtin_clzll(lo ^ hi);
+	unsigned shift = bits > split ? bits - split : 0;
+	size_t nc = (n + chunk - 1) / chunk;
+	std::vector<size_t> cnt(nc * nb);
+	run_chunked(threads, n, [&](size_t b, size_t e){
+		size_t *c = &cnt[b / chunk * nb];
+		for (size_t j=b; j<e; j++)
+			c[a[j].k >> shift & (nb - 1)]++;
+	});
+	std::vector<size_t> start(nb + 1);
+	for (size_t d=0, s=0; d<nb; d++) {
+		start[d] = s;
+		for (size_t c=0; c<nc; c++) {
+			size_t m = cnt[c * nb + d];
+			cnt[c * nb + d] = s;
+			s += m;
+		}
+	}
+	start[nb] = n;
+	run_chunked(threads, n, [&](size_t b, size_t e){
+		size_t *c = &cnt[b / chunk * nb];
+		for (size_t j=b; j<e; j++)
+			t[c[a[j].k >> shift & (nb - 1)]++] = a[j];
+	});
+	run(threads, nb, [&](size_t d){
+		size_t b = start[d], m = start[d+1] - b;
+		lsd_sort(t.data() + b, a.data() + b, m, shift);
+		std::copy(t.data() + b, t.data() + b + m, a.data() + b);
+	});
+}
+
+template <typename It>
+using value_t = typename std::iterator_traits<It>::value_type;
+
+template <typename It>
+inline constexpr bool is_exact_range = std::is_same_v<value_t<It>,Z> ||
+                                       std::is_same_v<value_t<It>,Q>;
+
+template <typename It>
+std::vector<enclosure> enclosures(It first, size_t n, unsigned threads)
+{
+	std::vector<enclosure> r(n);
+	run_chunked(threads, n, [&](size_t b, size_t e){
+		for (size_t j=b; j<e; j++)
+			r[j] = enclose(first[j]);
+	});
+	return r;
+}
+
+/* moves the element at first[a[j].i] to first[j] */
+template <typename It>
+void permute(It first, const std::vector<entry> &a, unsigned threads)
+{
+	size_t n = size(a);
+	std::vector<value_t<It>> t(n);
+	run_chunked(threads, n, [&](size_t b, size_t e){
+		for (size_t j=b; j<e; j++)
+			t[j] = std::move(first[a[j].i]);
+	});
+	run_chunked(threads, n, [&](size_t b, size_t e){
+		for (size_t j=b; j<e; j++)
+			first[j] = std::move(t[j]);
+	});
+}
+
+}
+
+/* Sorts the range of Z or Q values ascendingly. The elements are ordered by
+ * sort_detail::enclosure keys with a radix sort, in parallel on the executor of
+ * kay::parallel for large inputs, and compared exactly only in runs of
+ * overlapping enclosures. For Q these bracket the value by the truncated
+ * double and its neighbour, for Z they consist of sign, bit length and leading
+ * bits. Not stable. */
+template <typename It>
+std::enable_if_t<sort_detail::is_exact_range<It>>
+sort(It first, It last)
+{
+	using namespace sort_detail;
+	size_t n = last - first;
+	if (n < 2)
+		return;
+	unsigned threads = n_threads(n);
+	std::vector<enclosure> k = enclosures(first, n, threads);
+	std::vector<entry> a(n);
+	for (size_t j=0; j<n; j++)
+		a[j] = { k[j].lo, j };
+	sort_keys(a, threads);
+
+	std::vector<std::pair<size_t,size_t>> runs;
+	for (size_t b=0; b<n;) {
+		uint64_t hi = k[a[b].i].hi;
+		size_t e = b + 1;
+		for (; e < n && a[e].k <= hi; e++)
+			hi = std::max(hi, k[a[e].i].hi);
+		if (e - b > 1)
+			runs.emplace_back(b, e);
+		b = e;
+	}
+	run(threads, size(runs), [&](size_t r){
+		std::sort(a.begin() + runs[r].first, a.begin() + runs[r].second,
+		          [first](const entry &x, const entry &y){
+			return first[x.i] < first[y.i];
+		});
+	});
+	permute(first, a, threads);
+}
+
+/* Rearranges the range of Z or Q values such that nth holds the value it would
+ * in the sorted range, with no larger element before and no smaller one after
+ * it. The nth smallest lower and upper keys bracket its value; elements with
+ * enclosures entirely below or above that bracket are placed without exact
+ * comparison. */
+template <typename It>
+std::enable_if_t<sort_detail::is_exact_range<It>>
+nth_element(It first, It nth, It last)
+{
+	using namespace sort_detail;
+	size_t n = last - first, m = nth - first;
+	if (m >= n || n < 2)
+		return;
+	unsigned threads = n_threads(n);
+	std::vector<enclosure> k = enclosures(first, n, threads);
+	std::vector<uint64_t> v(n);
+	for (size_t j=0; j<n; j++)
+		v[j] = k[j].lo;
+	std::nth_element(v.begin(), v.begin() + m, v.end());
+	uint64_t lo = v[m];
+	for (size_t j=0; j<n; j++)
+		v[j] = k[j].hi;
+	std::nth_element(v.begin(), v.begin() + m, v.end());
+	uint64_t hi = v[m];
+
+	std::vector<entry> a(n);
+	size_t below = 0, above = n;
+	for (size_t j=0; j<n; j++)
+		if (k[j].hi < lo)
+			a[below++] = { 0, j };
+		else if (k[j].lo > hi)
+			a[--above] = { 0, j };
+	for (size_t j=0, p=below; j<n; j++)
+		if (k[j].hi >= lo && k[j].lo <= hi)
+			a[p++] = { 0, j };
+	std::nth_element(a.begin() + below, a.begin() + m, a.begin() + above,
+	                 [first](const entry &x, const entry &y){
+		return first[x.i] < first[y.i];
+	});
+	permute(first, a, threads);
+}
+
+}
+
+#endif
@@ -0,0 +1,196 @@
+/*
+ * tables.hh
+ *
+ * Copyright 2018-2022 Franz Brauße <fb@paxle.org>
+ *
+ * See the LICENSE file for terms of distribution.
+ */
+
+#ifndef KAY_TABLES_HH
+#define KAY_TABLES_HH
+
+#include <kay/numbers.hh>
+#include <kay/compiletime.hh>
+
+namespace kay {
+
+/* Tables of exact integers computed at compile time. The limbs of the values
+ * are static read-only data and so are the mpz structures referring to them,
+ * the Z entries are read-only views of those: accessing a table performs no
+ * bignum arithmetic and no allocation. The Z references must not be
+ * modified. */
+
+namespace tables {
+
+using compiletime::nat;
+
+namespace detail {
+
+constexpr size_t bitlen(size_t v)
+{
+	size_t r = 0;
+	for (; v; v >>= 1)
+		r++;
+	return r;
+}
+
+}
+
+/* Generators provide the capacity in limbs sufficient for a table of n values
+ * and these values. */
+
+/* i! */
+struct factorial {
+	static constexpr size_t limbs(size_t n) { return n * detail::bitlen(n) / 64 + 1; }
+
+	template <size_t K, size_t N>
+	static constexpr std::array<nat<K>,N> values()
+	{
+		std::array<nat<K>,N> r {};
+		for (size_t i=0; i<N; i++)
+			r[i] = i ? r[i-1] * i : nat<K>(1);
+		return r;
+	}
+};
+
+/* binomial(n, i) */
+template <size_t n>
+struct binomial {
+	static constexpr size_t limbs(size_t) { return (n + 64) / 64 + 1; }
+
+	template <size_t K, size_t N>
+	static constexpr std::array<nat<K>,N> values()
+	{
+		std::array<nat<K>,N> r {};
+		for (size_t i=0; i<N && i<=n; i++)
+			r[i] = i ? r[i-1] * (n-i+1) / nat<K>(i) : nat<K>(1);
+		return r;
+	}
+};
+
+/* 10^i */
+struct pow10 {
+	static constexpr size_t limbs(size_t n) { return 4 * n / 64 + 1; }
+
+	template <size_t K, size_t N>
+	static constexpr std::array<nat<K>,N> values()
+	{
+		std::array<nat<K>,N> r {};
+		for (size_t i=0; i<N; i++)
+			r[i] = i ? r[i-1] * 10 : nat<K>(1);
+		return r;
+	}
+};
+
+/* 2^i + s for s in {-1, +1} */
+template <int s>
+struct pow2_offset {
+	static_assert(s == -1 || s == 1);
+
+	static constexpr size_t limbs(size_t n) { return n / 64 + 1; }
+
+	template <size_t K, size_t N>
+	static constexpr std::array<nat<K>,N> values()
+	{
+		std::array<nat<K>,N> r {};
+		for (size_t i=0; i<N; i++)
+			r[i] = s < 0 ? (nat<K>(1) << i) - 1 : (nat<K>(1) << i) + 1;
+		return r;
+	}
+};
+
+namespace detail {
+
+/* the values of Gen as read-only mpz structures */
+template <typename Gen, size_t N>
+struct data {
+	static_assert(GMP_LIMB_BITS == 64 && GMP_NAIL_BITS == 0,
+	              "only 64-bit limbs are supported");
+
+	static constexpr size_t K = Gen::limbs(N);
+	static constexpr std::array<nat<K>,N> values = Gen::template values<K,N>();
+
+	static constexpr std::array<size_t,N+1> offsets = [] {
+		std::array<size_t,N+1> r {};
+		for (size_t i=0; i<N; i++)
+			r[i+1] = r[i] + values[i].size();
+		return r;
+	}();
+
+	static constexpr std::array<mp_limb_t,offsets[N]> limbs = [] {
+		std::array<mp_limb_t,offsets[N]> r {};
+		for (size_t i=0; i<N; i++)
+			for (size_t j=offsets[i]; j<offsets[i+1]; j++)
+				r[j] = values[i][j-offsets[i]];
+		return r;
+	}();
+
+	template <size_t... is>
+	static constexpr std::array<__mpz_struct,N> make(std::index_sequence<is...>)
+	{
+		/* GMP never writes to _mp_d of integers with _mp_alloc == 0 */
+		return {{ { 0, (int)values[is].size(),
+		            const_cast<mp_limb_t *>(limbs.data() + offsets[is]) }... }};
+	}
+
+	static constexpr std::array<__mpz_struct,N> mpz = make(std::make_index_sequence<N>{});
+};
+
+}
+
+template <typename Gen, size_t N>
+class Z_table {
+
+	using D = detail::data<Gen,N>;
+
+#if (KAY_USE_FLINT-0)
+	static_assert(sizeof(Z) == sizeof(fmpz));
+
+	/* Canonical fmpz referring to the read-only mpz structures, built on
+	 * first use. They are never cleared. */
+	static const std::array<fmpz,N> & views()
+	{
+		static const std::array<fmpz,N> v = [] {
+			std::array<fmpz,N> r {};
+			for (size_t i=0; i<N; i++)
+				r[i] = flintxx::fmpz_view(&D::mpz[i]);
+			return r;
+		}();
+		return v;
+	}
+
+	static const Z * data()
+	{
+		return reinterpret_cast<const Z *>(views().data());
+	}
+#else
+	static_assert(sizeof(Z) == sizeof(__mpz_struct));
+
+	static const Z * data()
+	{
+		return reinterpret_cast<const Z *>(D::mpz.data());
+	}
+#endif
+
+public:
+	static constexpr size_t size() { return N; }
+
+	const Z & operator[](size_t i) const { assert(i < N); return data()[i]; }
+
+	const Z * begin() const { return data(); }
+	const Z * end()   const { return data() + N; }
+};
+
+/* the tables of i!, binomial(n, i), 10^i, 2^i - 1 and 2^i + 1 for 0 <= i < N
+ * (i <= n for binomial) */
+template <size_t N> inline constexpr Z_table<factorial,N> factorials {};
+template <size_t n> inline constexpr Z_table<binomial<n>,n+1> binomials {};
+template <size_t N> inline constexpr Z_table<pow10,N> powers_of_10 {};
+template <size_t N> inline constexpr Z_table<pow2_offset<-1>,N> pow2_minus_1 {};
+template <size_t N> inline constexpr Z_table<pow2_offset<+1>,N> pow2_plus_1 {};
+
+}
+
+}
+
+#endif
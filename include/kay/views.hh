@@ -0,0 +1,247 @@
+/*
+ * views.hh
+ *
+ * Copyright 2018-2022 Franz Brauße <fb@paxle.org>
+ *
+ * See the LICENSE file for terms of distribution.
+ */
+
+#ifndef KAY_VIEWS_HH
+#define KAY_VIEWS_HH
+
+#include <type_traits>	/* std::enable_if_t */
+#include <functional>	/* std::hash */
+
+#include <kay/numbers.hh>
+
+namespace kay {
+
+/* Non-owning read-only views of integers and rationals stored elsewhere, e.g.
+ * in serialized or memory-mapped data. A view refers to the limbs of the value,
+ * which must remain valid and unchanged during its lifetime. It is a Z or Q
+ * for the purpose of reading: it converts to const Z & or const Q & which
+ * must not be modified. */
+
+class Zview {
+
+	static_assert(GMP_NAIL_BITS == 0);
+
+	__mpz_struct z;
+#if (KAY_USE_FLINT-0)
+	fmpz f;
+#endif
+
+	void init()
+	{
+		z._mp_alloc = 0;
+#if (KAY_USE_FLINT-0)
+		f = flintxx::fmpz_view(&z);
+#endif
+	}
+
+public:
+	/* the integer *v */
+	explicit Zview(mpz_srcptr v) : z(*v) { init(); }
+
+	/* the integer given by n little-endian limbs in d and the sign */
+	Zview(const mp_limb_t *d, size_t n, bool negative = false)
+	{
+		while (n && !d[n-1])
+			n--;
+		z._mp_size = negative ? -(int)n : (int)n;
+		z._mp_d = const_cast<mp_limb_t *>(d);
+		init();
+	}
+
+	explicit Zview(const mpz_class &v) : Zview(v.get_mpz_t()) {}
+
+	Zview(const Zview &v) : Zview(&v.z) {}
+	Zview & operator=(const Zview &v) { z = v.z; init(); return *this; }
+
+	mpz_srcptr get_mpz_t() const { return &z; }
+
+	const Z & get() const
+	{
+#if (KAY_USE_FLINT-0)
+		return reinterpret_cast<const Z &>(f);
+#else
+		return reinterpret_cast<const Z &>(z);
+#endif
+	}
+
+	operator const Z &() const { return get(); }
+
+	explicit operator bool() const { return z._mp_size; }
+
+	friend int sgn(const Zview &v) { return sgn(v.get()); }
+	friend size_t bits(const Zview &v) { return bits(v.get()); }
+	friend mp_bitcnt_t ctz(const Zview &v) { return ctz(v.get()); }
+	friend double get_d(const Zview &v) { return mpz_get_d(v.get_mpz_t()); }
+};
+
+#if (KAY_USE_FLINT-0)
+static_assert(sizeof(Z) == sizeof(fmpz));
+#else
+static_assert(sizeof(Z) == sizeof(__mpz_struct));
+#endif
+
+class Qview {
+
+	__mpq_struct q;
+#if (KAY_USE_FLINT-0)
+	fmpq f;
+#endif
+
+	void init()
+	{
+		q._mp_num._mp_alloc = 0;
+		q._mp_den._mp_alloc = 0;
+#if (KAY_USE_FLINT-0)
+		f.num = flintxx::fmpz_view(&q._mp_num);
+		f.den = flintxx::fmpz_view(&q._mp_den);
+#endif
+	}
+
+public:
+	/* the canonical rational *v */
+	explicit Qview(mpq_srcptr v) : q(*v) { init(); }
+
+	/* num/den, which must be in lowest terms with den > 0 */
+	Qview(const Zview &num, const Zview &den)
+	: q { *num.get_mpz_t(), *den.get_mpz_t() }
+	{ assert(sgn(den) > 0); init(); }
+
+	explicit Qview(const mpq_class &v) : Qview(v.get_mpq_t()) {}
+
+	Qview(const Qview &v) : Qview(&v.q) {}
+	Qview & operator=(const Qview &v) { q = v.q; init(); return *this; }
+
+	mpq_srcptr get_mpq_t() const { return &q; }
+
+	Zview get_num() const { return Zview(&q._mp_num); }
+	Zview get_den() const { return Zview(&q._mp_den); }
+
+	const Q & get() const
+	{
+#if (KAY_USE_FLINT-0)
+		return reinterpret_cast<const Q &>(f);
+#else
+		return reinterpret_cast<const Q &>(q);
+#endif
+	}
+
+	operator const Q &() const { return get(); }
+
+	explicit operator bool() const { return q._mp_num._mp_size; }
+
+	friend int sgn(const Qview &v) { return sgn(v.get()); }
+	friend double get_d(const Qview &v) { return mpq_get_d(v.get_mpq_t()); }
+};
+
+#if (KAY_USE_FLINT-0)
+static_assert(sizeof(Q) == sizeof(fmpq));
+#else
+static_assert(sizeof(Q) == sizeof(__mpq_struct));
+#endif
+
+namespace _detail {
+
+/* the number type viewed by Zview and Qview, respectively */
+template <typename T> struct kind_of { using type = void; };
+template <> struct kind_of<Z> { using type = Z; };
+template <> struct kind_of<Zview> { using type = Z; };
+template <> struct kind_of<Q> { using type = Q; };
+template <> struct kind_of<Qview> { using type = Q; };
+
+template <typename T> using kind_of_t = typename kind_of<T>::type;
+
+template <typename T>
+constexpr bool is_view_v = std::is_same_v<T,Zview> || std::is_same_v<T,Qview>;
+
+inline const Z & viewed(const Z &v) { return v; }
+inline const Z & viewed(const Zview &v) { return v.get(); }
+inline const Q & viewed(const Q &v) { return v; }
+inline const Q & viewed(const Qview &v) { return v.get(); }
+
+/* at least one of A, B is a view and both are of the same kind */
+template <typename A, typename B, typename R>
+using if_view_operands = std::enable_if_t<(is_view_v<A> || is_view_v<B>) &&
+                                          !std::is_void_v<kind_of_t<A>> &&
+                                          std::is_same_v<kind_of_t<A>,kind_of_t<B>>,
+                                          R>;
+
+}
+
+template <typename A, typename B>
+inline _detail::if_view_operands<A,B,int> cmp(const A &a, const B &b)
+{
+	return cmp(_detail::viewed(a), _detail::viewed(b));
+}
+
+template <typename A, typename B>
+inline _detail::if_view_operands<A,B,bool> operator==(const A &a, const B &b)
+{ return cmp(a, b) == 0; }
+template <typename A, typename B>
+inline _detail::if_view_operands<A,B,bool> operator!=(const A &a, const B &b)
+{ return cmp(a, b) != 0; }
+template <typename A, typename B>
+inline _detail::if_view_operands<A,B,bool> operator< (const A &a, const B &b)
+{ return cmp(a, b) <  0; }
+template <typename A, typename B>
+inline _detail::if_view_operands<A,B,bool> operator<=(const A &a, const B &b)
+{ return cmp(a, b) <= 0; }
+template <typename A, typename B>
+inline _detail::if_view_operands<A,B,bool> operator> (const A &a, const B &b)
+{ return cmp(a, b) >  0; }
+template <typename A, typename B>
+inline _detail::if_view_operands<A,B,bool> operator>=(const A &a, const B &b)
+{ return cmp(a, b) >= 0; }
+
+/* views as right operands of arithmetic */
+
+inline Z & operator+=(Z &a, const Zview &b) { return a += b.get(); }
+inline Z & operator-=(Z &a, const Zview &b) { return a -= b.get(); }
+inline Z & operator*=(Z &a, const Zview &b) { return a *= b.get(); }
+inline Z & operator/=(Z &a, const Zview &b) { return a /= b.get(); }
+inline Z & operator%=(Z &a, const Zview &b) { return a %= b.get(); }
+
+inline Z operator+(Z a, const Zview &b) { a += b; return a; }
+inline Z operator-(Z a, const Zview &b) { a -= b; return a; }
+inline Z operator*(Z a, const Zview &b) { a *= b; return a; }
+inline Z operator/(Z a, const Zview &b) { a /= b; return a; }
+inline Z operator%(Z a, const Zview &b) { a %= b; return a; }
+
+inline Q & operator+=(Q &a, const Qview &b) { return a += b.get(); }
+inline Q & operator-=(Q &a, const Qview &b) { return a -= b.get(); }
+inline Q & operator*=(Q &a, const Qview &b) { return a *= b.get(); }
+inline Q & operator/=(Q &a, const Qview &b) { return a /= b.get(); }
+
+inline Q operator+(Q a, const Qview &b) { a += b; return a; }
+inline Q operator-(Q a, const Qview &b) { a -= b; return a; }
+inline Q operator*(Q a, const Qview &b) { a *= b; return a; }
+inline Q operator/(Q a, const Qview &b) { a /= b; return a; }
+
+}
+
+namespace std {
+
+/* consistent with the hashes of Z and Q */
+template <>
+struct hash<kay::Zview> {
+	size_t operator()(const kay::Zview &v) const noexcept
+	{
+		return hash<kay::Z>{}(v.get());
+	}
+};
+
+template <>
+struct hash<kay::Qview> {
+	size_t operator()(const kay::Qview &v) const noexcept
+	{
+		return hash<kay::Q>{}(v.get());
+	}
+};
+
+}
+
+#endif